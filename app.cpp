@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <stdint.h>
 #include <cstring>
 #include <cstdio>
@@ -26,6 +27,10 @@
 #include "app.h"
 #include "numlock.h"
 #include "util.h"
+#include "threadpool.h"
+#include "imagecache.h"
+#include "renderer.h"
+#include <X11/extensions/security.h>
 
 
 #ifdef HAVE_SHADOW
@@ -42,6 +47,9 @@ int conv(int num_msg, const struct pam_message **msg,
     *resp = (struct pam_response *) calloc(num_msg, sizeof(struct pam_response));
     Panel* panel = *static_cast<Panel**>(appdata_ptr);
     int result = PAM_SUCCESS;
+    // Losing the server ends the conversation, as exceptions can't be
+    // thrown through PAM
+    try{
     for (int i=0; i<num_msg; i++){
         (*resp)[i].resp=0;
         (*resp)[i].resp_retcode=0;
@@ -89,6 +97,10 @@ int conv(int num_msg, const struct pam_message **msg,
         }
         if (result!=PAM_SUCCESS) break;
     }
+    }
+    catch(ServerLost&){
+        result=PAM_CONV_ERR;
+    }
     if (result!=PAM_SUCCESS){
         for (int i=0; i<num_msg; i++){
             if ((*resp)[i].resp==0) continue;
@@ -104,11 +116,29 @@ int conv(int num_msg, const struct pam_message **msg,
 
 extern App* LoginApp;
 
-int xioerror(Display *disp) {
-    LoginApp->RestartServer();
+/* Xlib can't be unwound through; the loss is taken up by the event
+ * loop instead, once Xlib returns */
+int xioerror(Display *) {
+    LoginApp->LoseDisplay();
+#ifndef HAVE_XSETIOERROREXITHANDLER
+    // Xlib exits once this returns
+    logStream << APPNAME << ": can't recover without XSetIOErrorExitHandler"
+              << endl;
+    if (LoginApp->isServerStarted())
+        LoginApp->StopServer();
+    LoginApp->RemoveLock();
+    exit(ERR_EXIT);
+#endif
     return 0;
 }
 
+#ifdef HAVE_XSETIOERROREXITHANDLER
+/* Return into Xlib instead of exiting; it ignores requests on the lost
+ * display from then on */
+static void ioErrorExit(Display *, void *) {
+}
+#endif
+
 void CatchSignal(int sig) {
     logStream << APPNAME << ": unexpected signal " << sig << endl;
 
@@ -119,23 +149,83 @@ void CatchSignal(int sig) {
     exit(ERR_EXIT);
 }
 
-void User1Signal(int sig) {
-    signal(sig, User1Signal);
+/* Signals that end slim; CatchSignal handles them from the event loop,
+ * or as a signal handler while a command runs */
+static const int QUIT_SIGNALS[] = {
+    SIGQUIT, SIGTERM, SIGINT, SIGHUP, SIGPIPE, 0
+};
+
+static void quitSignal(void*, int sig) {
+    CatchSignal(sig);
+}
+
+/* The X server sends SIGUSR1 once it accepts connections, which is read
+ * from the event loop; the handler keeps one sent outside of it from
+ * killing slim */
+static void User1Signal(int) {
+}
+
+static void wakeUp(void* data, int) {
+    *static_cast<bool*>(data) = true;
+}
+
+/* Size of the screen the X server is about to set up, guessed from the
+ * preferred mode of the first connected DRM output */
+static bool guessScreenSize(int* width, int* height) {
+    const string drm = "/sys/class/drm";
+    DIR* dir = opendir(drm.c_str());
+    if (dir == NULL)
+        return false;
+
+    bool found = false;
+    struct dirent* entry;
+    while (!found && (entry = readdir(dir)) != NULL) {
+        // Outputs are named like card0-HDMI-A-1
+        if (strncmp(entry->d_name, "card", 4) != 0
+            || strchr(entry->d_name, '-') == NULL)
+        {
+            continue;
+        }
+
+        string output = drm + "/" + entry->d_name;
+        string status;
+        ifstream status_file((output + "/status").c_str());
+        if (!(status_file >> status) || status != "connected")
+            continue;
+
+        // The first mode listed is the preferred one, as in "1920x1080"
+        string mode;
+        ifstream modes_file((output + "/modes").c_str());
+        if (modes_file >> mode
+            && sscanf(mode.c_str(), "%dx%d", width, height) == 2
+            && *width > 0 && *height > 0)
+        {
+            found = true;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+/* Channel order of the usual 24 bit visual of a local server */
+static ChannelOrder guessChannelOrder() {
+    const uint32_t one = 1;
+    return *(const unsigned char *) &one == 1 ? ORDER_BGRA : ORDER_RGBA;
 }
 
 
-#ifdef USE_PAM
-App::App(int argc, char** argv)
-  : pam(conv, static_cast<void*>(&LoginPanel)),
-#else
 App::App(int argc, char** argv)
-  :
+  : Dpy(NULL), displayLost(false), ServerPID(-1), serverStarted(false),
+    serverState(NULL),
+#ifdef USE_PAM
+    pam(conv, static_cast<void*>(&LoginPanel)),
 #endif
+    BackgroundPixmap(None), assets(NULL), state(STATE_START),
+    events(NULL), serverWakeup(false), loginFailed(false),
+    firstlogin(true), daemonized(false), daemonmode(false),
+    force_nodaemon(false), testing(false),
     mcookiesize(32), // Must be divisible by 4
-    ServerPID(-1), testing(false),
-    serverStarted(false), mcookie(string(App::mcookiesize, 'a')),
-    daemonmode(false), force_nodaemon(false),
-    firstlogin(true), Dpy(NULL)
+    mcookie(string(App::mcookiesize, 'a'))
 {
     int tmp;
 
@@ -196,10 +286,41 @@ void App::Run() {
     }
 #endif
 
+    state = STATE_START;
+
+    for (;;) {
+        try {
+            switch (state) {
+            case STATE_START:
+                startGreeter();
+                state = STATE_GREET;
+                break;
+            case STATE_GREET:
+                greet();
+                break;
+            case STATE_RESTART:
+                stopGreeter();
+                state = STATE_START;
+                break;
+            }
+        }
+        catch (ServerLost&) {
+            // RestartServer has set the state
+        }
+    }
+}
+
+/* Read the configuration and theme, start the X server and set up the
+ * panel on it */
+void App::startGreeter() {
+    events = new EventLoop;
 
     // Read configuration and theme
     cfg = new Cfg;
     cfg->readConf(CFGFILE);
+    // A theme being tried out is not worth keeping images of
+    if (testing)
+        cfg->getOption("cache_dir") = "";
     string themebase = "";
     string themefile = "";
     string themedir = "";
@@ -250,18 +371,28 @@ void App::Run() {
         }
     }
 
+    ThreadPool::SetThreads(cfg->getOption("threads"));
+
+    // Theme images are decoded once for the root window and the panel,
+    // and kept for the next server while the theme, its files and the
+    // options they are laid out by stay the same
+    if (assets != NULL && !assets->Matches(cfg, themedir)) {
+        delete assets;
+        assets = NULL;
+    }
+    if (assets == NULL)
+        assets = new ThemeAssets(cfg, themedir);
+
     if (!testing) {
         // Create lock file
         LoginApp->GetLock();
 
         // Start x-server
         setenv("DISPLAY", DisplayName, 1);
-        signal(SIGQUIT, CatchSignal);
-        signal(SIGTERM, CatchSignal);
-        signal(SIGKILL, CatchSignal);
-        signal(SIGINT, CatchSignal);
-        signal(SIGHUP, CatchSignal);
-        signal(SIGPIPE, CatchSignal);
+        for (int i = 0; QUIT_SIGNALS[i] != 0; i++) {
+            signal(QUIT_SIGNALS[i], CatchSignal);
+            events->WatchSignal(QUIT_SIGNALS[i], quitSignal, this);
+        }
         signal(SIGUSR1, User1Signal);
 
 #ifndef XNEST_DEBUG
@@ -269,12 +400,13 @@ void App::Run() {
             daemonmode = true;
         }
 
-        // Daemonize
-        if (daemonmode) {
+        // Daemonize, once
+        if (daemonmode && !daemonized) {
             if (daemon(0, 0) == -1) {
                 logStream << APPNAME << ": " << strerror(errno) << endl;
                 exit(ERR_EXIT);
             }
+            daemonized = true;
         }
 
         OpenLog();
@@ -282,23 +414,30 @@ void App::Run() {
         if (daemonmode)
             UpdatePid();
 
+        // Decode the theme while the X server starts
+        int width, height;
+        if (guessScreenSize(&width, &height))
+            assets->Preload(width, height, guessChannelOrder());
+
         CreateServerAuth();
         StartServer();
 #endif
 
     }
 
-    // Open display
-    if((Dpy = XOpenDisplay(DisplayName)) == 0) {
+    // Open display, unless waiting for the server did
+    if (Dpy == NULL && (Dpy = XOpenDisplay(DisplayName)) == 0) {
         logStream << APPNAME << ": could not open display '"
              << DisplayName << "'" << endl;
         if (!testing) StopServer();
         exit(ERR_EXIT);
     }
+    displayLost = false;
 
     // Get screen and root window
     Scr = DefaultScreen(Dpy);
     Root = RootWindow(Dpy, Scr);
+    BackgroundPixmap = None;
 
     // for tests we use a standard window
     if (testing) {
@@ -307,13 +446,28 @@ void App::Run() {
         XMapWindow(Dpy, Root);
         XFlush(Dpy);
     } else {
+        serverState = new ServerState(Dpy, Root);
         blankScreen();
     }
 
     HideCursor();
 
+    assets->Attach(Dpy, Scr);
+
     // Create panel
-    LoginPanel = new Panel(Dpy, Scr, Root, cfg, themedir);
+    LoginPanel = new Panel(Dpy, Scr, Root, cfg, themedir, assets, events);
+
+    // Set NumLock
+    string numlock = cfg->getOption("numlock");
+    if (numlock == "on") {
+        NumLock::setOn(Dpy);
+    } else if (numlock == "off") {
+        NumLock::setOff(Dpy);
+    }
+}
+
+/* Show the panel and run sessions until the server is to be restarted */
+void App::greet() {
     bool firstloop = true; // 1st time panel is shown (for automatic username)
     bool focuspass = cfg->getOption("focus_password")=="yes";
     bool autologin = cfg->getOption("auto_login")=="yes";
@@ -329,22 +483,14 @@ void App::Run() {
         }
     }
 
-    // Set NumLock
-    string numlock = cfg->getOption("numlock");
-    if (numlock == "on") {
-        NumLock::setOn(Dpy);
-    } else if (numlock == "off") {
-        NumLock::setOff(Dpy);
-    }
-
     // Start looping
     int panelclosed = 1;
     Panel::ActionType Action;
 
-    while(1) {
+    while (state == STATE_GREET) {
         if(panelclosed) {
             // Init root
-            setBackground(themedir);
+            setBackground(assets->ThemeDir());
 
             // Close all clients
             if (!testing) {
@@ -354,6 +500,10 @@ void App::Run() {
 
             // Show panel
             LoginPanel->OpenPanel();
+            if (loginFailed) {
+                LoginPanel->Error("Failed to execute login command", 3);
+                loginFailed = false;
+            }
         }
 
         LoginPanel->Reset();
@@ -405,6 +555,37 @@ void App::Run() {
     }
 }
 
+/* Stop the X server and release what was set up for it; the theme
+ * images stay for the next one */
+void App::stopGreeter() {
+#ifdef USE_PAM
+    try{
+        pam.end();
+    }
+    catch(PAM::Exception& e){
+        logStream << APPNAME << ": " << e << endl;
+    };
+#endif
+
+    // Requests on a lost display are dropped by Xlib
+    delete LoginPanel;
+    LoginPanel = NULL;
+
+    StopServer();
+    RemoveLock();
+    if (force_nodaemon) {
+        exit(ERR_EXIT); /* use ERR_EXIT so that systemd's RESTART=on-failure works */
+    }
+    while (waitpid(-1, NULL, WNOHANG) > 0); // Collects all dead childrens
+
+    delete serverState;
+    serverState = NULL;
+    delete cfg;
+    cfg = NULL;
+    delete events;
+    events = NULL;
+}
+
 #ifdef USE_PAM
 bool App::AuthenticateUser(bool focuspass){
     // Reset the username
@@ -414,6 +595,9 @@ bool App::AuthenticateUser(bool focuspass){
         pam.authenticate();
     }
     catch(PAM::Auth_Exception& e){
+        // The conversation gave up
+        if (displayLost)
+            RestartServer();
         switch(LoginPanel->getAction()){
             case Panel::Exit:
             case Panel::Console:
@@ -425,6 +609,8 @@ bool App::AuthenticateUser(bool focuspass){
         return false;
     }
     catch(PAM::Exception& e){
+        if (displayLost)
+            RestartServer();
         logStream << APPNAME << ": " << e << endl;
         exit(ERR_EXIT);
     };
@@ -572,9 +758,18 @@ void App::Login() {
     }
 #endif
 
+    // A server kept for the next session gives this one a cookie of
+    // its own, revoked when it ends
+    string cookie = mcookie;
+    XID session_auth = None;
+    const bool keep_server = cfg->getOption("keep_xserver") == "true"
+                             && serverState != NULL
+                             && CreateSessionAuth(cookie, &session_auth);
+
     // Create new process
     pid = fork();
     if(pid == 0) {
+        EventLoop::ResetChild();
 #ifdef USE_PAM
         // Get a copy of the environment and close the child's copy
         // of the PAM-handle.
@@ -633,7 +828,7 @@ void App::Login() {
             replaceVariables(sessStart, USER_VAR, pw->pw_name);
             system(sessStart.c_str());
         }
-        Su.Login(loginCommand.c_str(), mcookie.c_str());
+        Su.Login(loginCommand.c_str(), cookie.c_str());
         _exit(OK_EXIT);
     }
 
@@ -641,22 +836,36 @@ void App::Login() {
     CloseLog();
 #endif
 
-    // Wait until user is logging out (login process terminates)
-    pid_t wpid = -1;
-    int status;
-    while (wpid != pid) {
-        wpid = wait(&status);
-        if (wpid == ServerPID)
-            xioerror(Dpy);	// Server died, simulate IO error
+    // Wait until user is logging out (login process terminates),
+    // handling signals meanwhile
+    bool exited = false;
+    int status = 0;
+    events->WatchExit(pid, wakeUp, &exited);
+    events->WatchExit(ServerPID, wakeUp, &exited);
+    for (;;) {
+        exited = false;
+        if (waitpid(pid, &status, WNOHANG) == pid)
+            break;
+        if (ServerPID > 0 && waitpid(ServerPID, NULL, WNOHANG) == ServerPID)
+            RestartServer();
+        events->RunUntil(&exited);
     }
+    events->UnwatchExit(pid);
+    events->UnwatchExit(ServerPID);
+
     if (WIFEXITED(status) && WEXITSTATUS(status)) {
-        LoginPanel->Message("Failed to execute login command");
-        sleep(3);
+        // Shown with the panel if the server stays
+        if (keep_server) {
+            loginFailed = true;
+        } else {
+            LoginPanel->Message("Failed to execute login command");
+            events->Wait(3000);
+        }
     } else {
          string sessStop = cfg->getOption("sessionstop_cmd");
          if (sessStop != "") {
             replaceVariables(sessStop, USER_VAR, pw->pw_name);
-            system(sessStop.c_str());
+            events->System(sessStop.c_str());
         }
     }
 
@@ -678,6 +887,10 @@ void App::Login() {
     };
 #endif
 
+    // Disconnects the clients using the session's cookie, or one the
+    // session made with it
+    const bool revoked = keep_server && RevokeSessionAuth(session_auth);
+
 // Close all clients
     KillAllClients(False);
     KillAllClients(True);
@@ -692,9 +905,19 @@ void App::Login() {
     HideCursor();
 
 #ifndef XNEST_DEBUG
-    // Re-activate log file
-    OpenLog();
-    RestartServer();
+    if (keep_server) {
+        // Re-activate log file
+        OpenLog();
+        if (!revoked || !serverState->Restore(BackgroundPixmap)) {
+            logStream << APPNAME << ": clients of the session may be "
+                      << "left, restarting the X server" << endl;
+            CloseLog();
+            state = STATE_RESTART;
+        }
+    } else {
+        // The log is opened again with the new server
+        state = STATE_RESTART;
+    }
 #endif
 
 
@@ -713,12 +936,12 @@ void App::Reboot() {
 
     // Write message
     LoginPanel->Message((char*)cfg->getOption("reboot_msg").c_str());
-    sleep(3);
+    events->Wait(3000);
 
     // Stop server and reboot
     StopServer();
     RemoveLock();
-    system(cfg->getOption("reboot_cmd").c_str());
+    events->System(cfg->getOption("reboot_cmd").c_str());
     exit(OK_EXIT);
 }
 
@@ -735,18 +958,18 @@ void App::Halt() {
 
     // Write message
     LoginPanel->Message((char*)cfg->getOption("shutdown_msg").c_str());
-    sleep(3);
+    events->Wait(3000);
 
     // Stop server and halt
     StopServer();
     RemoveLock();
-    system(cfg->getOption("halt_cmd").c_str());
+    events->System(cfg->getOption("halt_cmd").c_str());
     exit(OK_EXIT);
 }
 
 void App::Suspend() {
-    sleep(1);
-    system(cfg->getOption("suspend_cmd").c_str());
+    events->Wait(1000);
+    events->System(cfg->getOption("suspend_cmd").c_str());
 }
 
 
@@ -762,7 +985,7 @@ void App::Console() {
     const char* cmd = cfg->getOption("console_cmd").c_str();
     char *tmp = new char[strlen(cmd) + 60];
     sprintf(tmp, cmd, width, height, posx, posy, fontx, fonty);
-    system(tmp);
+    events->System(tmp);
     delete [] tmp;
 }
 
@@ -782,7 +1005,7 @@ void App::Exit() {
     if (testing) {
         const char* testmsg= "¥·£·€·$·¢·₡·₢·₣·₤·₥·₦·₧·₨·₩·₪·₫·₭·₮·₯·₹";
 		LoginPanel->Message(testmsg);
-        sleep(3);
+        events->Wait(3000);
         delete LoginPanel;
         XCloseDisplay(Dpy);
     } else {
@@ -799,39 +1022,54 @@ int CatchErrors(Display *dpy, XErrorEvent *ev) {
     return 0;
 }
 
+/* The connection to the server is lost: unwind back into Run(),
+ * which starts over */
 void App::RestartServer() {
-#ifdef USE_PAM
-    try{
-        pam.end();
-    }
-    catch(PAM::Exception& e){
-        logStream << APPNAME << ": " << e << endl;
-    };
-#endif
+    displayLost = true;
+    state = STATE_RESTART;
+    throw ServerLost();
+}
 
-    StopServer();
-    RemoveLock();
-    if (force_nodaemon) {
-        delete LoginPanel;
-        exit(ERR_EXIT); /* use ERR_EXIT so that systemd's RESTART=on-failure works */
-    } else {
-        while (waitpid(-1, NULL, WNOHANG) > 0); // Collects all dead childrens
-        Run();
-    }
+/* Called from inside Xlib: restart from the event loop, the next time
+ * it runs */
+void App::LoseDisplay() {
+    if (displayLost)
+        return;
+    logStream << APPNAME << ": connection to X server lost." << endl;
+    displayLost = true;
+    if (events != NULL)
+        events->AddTimer(0, displayLostTimer, this);
+}
+
+void App::displayLostTimer(void* data, int) {
+    App* app = static_cast<App*>(data);
+    // Nothing to restart if the server was stopped meanwhile
+    if (app->Dpy != NULL)
+        app->RestartServer();
 }
 
 void App::KillAllClients(Bool top) {
     Window dummywindow;
-    Window *children;
+    Window *children = NULL;
     unsigned int nchildren;
     unsigned int i;
     XWindowAttributes attr;
 
+    // Xlib returns from calls on a lost display, with no results
+    if (displayLost)
+        return;
+
     XSync(Dpy, 0);
     XSetErrorHandler(CatchErrors);
 
     nchildren = 0;
-    XQueryTree(Dpy, Root, &dummywindow, &dummywindow, &children, &nchildren);
+    // Fails, leaving children alone, if the server is gone meanwhile
+    if (!XQueryTree(Dpy, Root, &dummywindow, &dummywindow, &children,
+                    &nchildren))
+    {
+        XSetErrorHandler(NULL);
+        return;
+    }
     if(!top) {
         for(i=0; i<nchildren; i++) {
             if(XGetWindowAttributes(Dpy, children[i], &attr) && (attr.map_state == IsViewable))
@@ -845,64 +1083,184 @@ void App::KillAllClients(Bool top) {
         if(children[i])
             XKillClient(Dpy, children[i]);
     }
-    XFree((char *)children);
+    if (children != NULL)
+        XFree((char *)children);
 
     XSync(Dpy, 0);
     XSetErrorHandler(NULL);
 }
 
 
+/* Wait up to timeout seconds for the X server to exit, returning as
+ * soon as it does; nonzero if it is still running */
 int App::ServerTimeout(int timeout, char* text) {
-    int    i = 0;
-    int pidfound = -1;
-    static char    *lasttext;
+    const long long deadline = Util::msecs() + timeout * 1000LL;
+
+    int pidfound = waitpid(ServerPID, NULL, WNOHANG);
+    if (pidfound < 0 && errno == ECHILD)
+        pidfound = ServerPID;   // already collected
+    if (pidfound == ServerPID || timeout <= 0)
+        return (ServerPID != pidfound);
+
+    logStream << endl << APPNAME << ": waiting for " << text;
 
-    for(;;) {
+    bool exited = false;
+    events->WatchExit(ServerPID, wakeUp, &exited);
+
+    for (;;) {
+        // Checked after the watch is set up, so an exit isn't missed
+        exited = false;
         pidfound = waitpid(ServerPID, NULL, WNOHANG);
-        if(pidfound == ServerPID)
+        if (pidfound < 0 && errno == ECHILD)
+            pidfound = ServerPID;
+        if (pidfound == ServerPID)
             break;
-        if(timeout) {
-            if(i == 0 && text != lasttext)
-                logStream << endl << APPNAME << ": waiting for " << text;
-            else
-                logStream << ".";
-        }
-        if(timeout)
-            sleep(1);
-        if(++i > timeout)
+
+        long long remaining = deadline - Util::msecs();
+        if (remaining <= 0)
             break;
+        events->RunUntil(&exited, (int) remaining);
     }
 
-    if(i > 0)
-        logStream << endl;
-    lasttext = text;
+    events->UnwatchExit(ServerPID);
+    logStream << endl;
 
     return (ServerPID != pidfound);
 }
 
 
 int App::WaitForServer() {
-    int    ncycles     = 120;
-    int    cycles;
+    const long long deadline = Util::msecs() + SERVER_START_TIMEOUT;
+    int found = 0;
+    // Woken up by SIGUSR1 from StartServer, or the server exiting
+    events->WatchExit(ServerPID, wakeUp, &serverWakeup);
+
+    for (;;) {
+        // Connect once the server says it is ready; try every second
+        // too, in case the signal went missing
+        long long remaining = deadline - Util::msecs();
+        if (remaining <= 0) {
+            logStream << APPNAME << ": X server not ready after "
+                      << SERVER_START_TIMEOUT / 1000 << " seconds, giving up."
+                      << endl;
+            break;
+        }
+        events->RunUntil(&serverWakeup,
+                         remaining < 1000 ? (int) remaining : 1000);
+        serverWakeup = false;
 
-    for(cycles = 0; cycles < ncycles; cycles++) {
         if((Dpy = XOpenDisplay(DisplayName))) {
             XSetIOErrorHandler(xioerror);
-            return 1;
-        } else {
-            if(!ServerTimeout(1, (char *) "X server to begin accepting connections"))
-                break;
+#ifdef HAVE_XSETIOERROREXITHANDLER
+            XSetIOErrorExitHandler(Dpy, ioErrorExit, NULL);
+#endif
+            found = 1;
+            break;
+        }
+
+        if (waitpid(ServerPID, NULL, WNOHANG) == ServerPID) {
+            logStream << APPNAME << ": X server exited while starting"
+                      << endl;
+            break;
         }
     }
 
-    logStream << "Giving up." << endl;
+    events->UnwatchExit(ServerPID);
+    return found;
+}
 
-    return 0;
+
+/* Have the server generate a cookie for a session, as a hex string.
+ * Needs the SECURITY extension.
+ */
+bool App::CreateSessionAuth(string& cookie, XID* id) {
+    int major, minor;
+    if (!XSecurityQueryExtension(Dpy, &major, &minor)) {
+        logStream << APPNAME << ": no SECURITY extension, restarting the "
+                  << "X server after each session" << endl;
+        return false;
+    }
+
+    char name[] = "MIT-MAGIC-COOKIE-1";
+    Xauth auth_in;
+    memset(&auth_in, 0, sizeof(auth_in));
+    auth_in.name = name;
+    auth_in.name_length = strlen(name);
+
+    // Trusted like the server's own cookie, and never timed out
+    XSecurityAuthorizationAttributes attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.timeout = 0;
+    attributes.trust_level = XSecurityClientTrusted;
+
+    XSecurityAuthorization auth_id;
+    Xauth* auth = XSecurityGenerateAuthorization(Dpy, &auth_in,
+        XSecurityTimeout | XSecurityTrustLevel, &attributes, &auth_id);
+    if (auth == NULL)
+        return false;
+
+    const char* digits = "0123456789abcdef";
+    cookie = "";
+    for (int i = 0; i < auth->data_length; i++) {
+        const unsigned char byte = auth->data[i];
+        cookie += digits[byte >> 4];
+        cookie += digits[byte & 0x0f];
+    }
+    XSecurityFreeXauth(auth);
+    *id = auth_id;
+    return true;
 }
 
+/* Revoke a session's cookie and every authorization the session may
+ * have made with it. The server can't list them, but numbers them in
+ * order: revoke each id up to that of a new one. False if that can't
+ * be done, or takes too long.
+ */
+bool App::RevokeSessionAuth(XID id) {
+    static const XID MAX_REVOKED = 0x10000;
+
+    char name[] = "MIT-MAGIC-COOKIE-1";
+    Xauth auth_in;
+    memset(&auth_in, 0, sizeof(auth_in));
+    auth_in.name = name;
+    auth_in.name_length = strlen(name);
+
+    XSecurityAuthorizationAttributes attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.trust_level = XSecurityClientUntrusted;
+
+    XSecurityAuthorization last = None;
+    Xauth* auth = XSecurityGenerateAuthorization(Dpy, &auth_in,
+        XSecurityTrustLevel, &attributes, &last);
+    if (auth != NULL)
+        XSecurityFreeXauth(auth);
+    else
+        last = None;
+
+    const bool sweep = last != None && last >= id
+                       && last - id <= MAX_REVOKED;
+
+    XSync(Dpy, False);
+    XSetErrorHandler(CatchErrors);
+    if (sweep) {
+        // Most ids are not authorizations; those fail harmlessly
+        for (XID i = id; i <= last; i++)
+            XSecurityRevokeAuthorization(Dpy, i);
+    } else {
+        XSecurityRevokeAuthorization(Dpy, id);
+        if (last != None)
+            XSecurityRevokeAuthorization(Dpy, last);
+    }
+    XSync(Dpy, False);
+    XSetErrorHandler(NULL);
+
+    return sweep;
+}
 
 int App::StartServer() {
-    ServerPID = fork();
+    // Held until WaitForServer reads it
+    serverWakeup = false;
+    events->WatchSignal(SIGUSR1, wakeUp, &serverWakeup);
 
     static const int MAX_XSERVER_ARGS = 256;
     static char* server[MAX_XSERVER_ARGS+2] = { NULL };
@@ -950,8 +1308,12 @@ int App::StartServer() {
     }
     server[argc] = NULL;
 
+    // The theme loader and image threads may hold locks across the
+    // fork, so the child only makes async-signal-safe calls
+    ServerPID = fork();
     switch(ServerPID) {
     case 0:
+        EventLoop::ResetChild();
         signal(SIGTTIN, SIG_IGN);
         signal(SIGTTOU, SIG_IGN);
         signal(SIGUSR1, SIG_IGN);
@@ -959,8 +1321,7 @@ int App::StartServer() {
 
 
         execvp(server[0], server);
-        logStream << APPNAME << ": X server could not be started" << endl;
-        exit(ERR_EXIT);
+        _exit(ERR_EXIT);
         break;
 
     case -1:
@@ -969,6 +1330,7 @@ int App::StartServer() {
     default:
         errno = 0;
         if(!ServerTimeout(0, (char *)"")) {
+            logStream << APPNAME << ": X server could not be started" << endl;
             ServerPID = -1;
             break;
         }
@@ -983,7 +1345,8 @@ int App::StartServer() {
         break;
     }
 
-    delete args;
+    delete [] args;
+    events->UnwatchSignal(SIGUSR1);
 
     serverStarted = true;
 
@@ -991,25 +1354,24 @@ int App::StartServer() {
 }
 
 
-jmp_buf CloseEnv;
-int IgnoreXIO(Display *d) {
-    logStream << APPNAME << ": connection to X server lost." << endl;
-    longjmp(CloseEnv, 1);
-}
-
-
 void App::StopServer() {
     signal(SIGQUIT, SIG_IGN);
     signal(SIGINT, SIG_IGN);
     signal(SIGHUP, SIG_IGN);
     signal(SIGPIPE, SIG_IGN);
     signal(SIGTERM, SIG_DFL);
-    signal(SIGKILL, SIG_DFL);
-
-    // Catch X error
-    XSetIOErrorHandler(IgnoreXIO);
-    if(!setjmp(CloseEnv) && Dpy)
-        XCloseDisplay(Dpy);
+    // Pending ones go to the dispositions above too
+    if (events != NULL)
+        for (int i = 0; QUIT_SIGNALS[i] != 0; i++)
+            events->UnwatchSignal(QUIT_SIGNALS[i]);
+
+    // Cleared first, so that losing the server while closing doesn't
+    // restart it; a lost display is closed without waiting on it
+    if (Dpy != NULL) {
+        Display* dpy = Dpy;
+        Dpy = NULL;
+        XCloseDisplay(dpy);
+    }
 
     // Send HUP to process group
     errno = 0;
@@ -1066,39 +1428,77 @@ void App::blankScreen()
 }
 
 void App::setBackground(const string& themedir) {
-    string filename;
-    filename = themedir + "/background.png";
-    image = new Image;
-    bool loaded = image->Read(filename.c_str());
-    if (!loaded){ // try jpeg if png failed
-        filename = "";
-        filename = themedir + "/background.jpg";
-        loaded = image->Read(filename.c_str());
-    }
-    if (loaded) {
-        string bgstyle = cfg->getOption("background_style");
-        if (bgstyle == "stretch") {
-            image->Resize(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)));
-        } else if (bgstyle == "tile") {
-            image->Tile(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)));
-        } else if (bgstyle == "center") {
-            string hexvalue = cfg->getOption("background_color");
-            hexvalue = hexvalue.substr(1,6);
-            image->Center(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                        hexvalue.c_str());
-        } else { // plain color or error
-            string hexvalue = cfg->getOption("background_color");
-            hexvalue = hexvalue.substr(1,6);
-            image->Center(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                        hexvalue.c_str());
+    // The root pixmap of an earlier session on this server is kept
+    if (BackgroundPixmap != None) {
+        XSetWindowBackgroundPixmap(Dpy, Root, BackgroundPixmap);
+        XClearWindow(Dpy, Root);
+        XFlush(Dpy);
+        return;
+    }
+
+    string bgstyle = cfg->getOption("background_style");
+    int width = XWidthOfScreen(ScreenOfDisplay(Dpy, Scr));
+    int height = XHeightOfScreen(ScreenOfDisplay(Dpy, Scr));
+
+    ImageCache cache(cfg->getOption("cache_dir"), "background");
+    cache.Add(themedir);
+    cache.AddFile(themedir + "/background.png");
+    cache.AddFile(themedir + "/background.jpg");
+    cache.AddScreen(Dpy, Scr);
+    cache.Add(bgstyle);
+    cache.Add(cfg->getOption("background_color"));
+
+    Pixmap p = None;
+    XImageBuffer* buffer = cache.Load(Dpy, Scr);
+    if (buffer == NULL && cfg->getOption("xrender") == "true")
+        p = renderBackground();
+    if (buffer == NULL && p == None) {
+        buffer = new XImageBuffer(Dpy, Scr, width, height);
+        if (buffer->Valid() && readBackground(buffer)) {
+            cache.Save(*buffer);
+        } else {
+            delete buffer;
+            buffer = NULL;
         }
-        Pixmap p = image->createPixmap(Dpy, Scr, Root);
-        XSetWindowBackgroundPixmap(Dpy, Root, p);
     }
+    if (buffer != NULL) {
+        p = buffer->CreatePixmap(Root);
+        delete buffer;
+    }
+    if (p != None)
+        XSetWindowBackgroundPixmap(Dpy, Root, p);
+    BackgroundPixmap = p;
     XClearWindow(Dpy, Root);
 
     XFlush(Dpy);
-    delete image;
+}
+
+/* Prepare the background on the server; None if RENDER is missing */
+Pixmap App::renderBackground() {
+    Renderer renderer(Dpy, Scr, Root);
+    if (!renderer.Valid())
+        return(None);
+
+    const Image* background = assets->Background();
+    if (background == NULL)
+        return(None);
+
+    int width = XWidthOfScreen(ScreenOfDisplay(Dpy, Scr));
+    int height = XHeightOfScreen(ScreenOfDisplay(Dpy, Scr));
+    Image image(background);
+    return(renderer.Background(&image, cfg->getOption("background_style"),
+                               cfg->getOption("background_color"),
+                               0, 0, width, height));
+}
+
+/* Prepare the background at screen size into sink */
+bool App::readBackground(RowSink* sink) {
+    const Image* frame = assets->Frame();
+    if (frame == NULL)
+        return(false);
+
+    frame->PutRows(sink);
+    return(true);
 }
 
 // Check if there is a lockfile and a corresponding process
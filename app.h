@@ -17,12 +17,14 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <errno.h>
-#include <setjmp.h>
 #include <stdlib.h>
 #include <iostream>
 #include "panel.h"
 #include "cfg.h"
 #include "image.h"
+#include "themeassets.h"
+#include "serverstate.h"
+#include "eventloop.h"
 
 #ifdef USE_PAM
 #include "PAM.h"
@@ -31,6 +33,10 @@
 #include "Ck.h"
 #endif
 
+/* Thrown once the X server is lost, to unwind back into App::Run() */
+class ServerLost {
+};
+
 class App {
 public:
     App(int argc, char** argv);
@@ -38,6 +44,8 @@ public:
     void Run();
     int GetServerPID();
     void RestartServer();
+    /* The IO error handler's way of calling RestartServer */
+    void LoseDisplay();
     void StopServer();
 
     // Lock functions
@@ -47,6 +55,18 @@ public:
     bool isServerStarted();
 
 private:
+    /* Where the greeter is in its cycle of X servers */
+    enum State {
+        STATE_START,        // read the configuration, start a server
+        STATE_GREET,        // show the panel and run sessions
+        STATE_RESTART       // stop the server, release its resources
+    };
+
+    void startGreeter();
+    void greet();
+    void stopGreeter();
+    static void displayLostTimer(void* data, int timer);
+
     void Login();
     void Reboot();
     void Halt();
@@ -70,6 +90,8 @@ private:
                                  const std::string& value);
 
     // Server functions
+    bool CreateSessionAuth(std::string& cookie, XID* id);
+    bool RevokeSessionAuth(XID id);
     int StartServer();
     int ServerTimeout(int timeout, char *string);
     int WaitForServer();
@@ -77,11 +99,14 @@ private:
     // Private data
     Window Root;
     Display* Dpy;
+    bool displayLost;
     int Scr;
     Panel* LoginPanel;
     int ServerPID;
     const char* DisplayName;
     bool serverStarted;
+    // Settings of the fresh server, for reusing it after a session
+    ServerState* serverState;
 
 #ifdef USE_PAM
 	PAM::Authenticator pam;
@@ -98,10 +123,21 @@ private:
     Pixmap BackgroundPixmap;
 
     void blankScreen();
-    Image* image;
+    ThemeAssets* assets;
     void setBackground(const std::string& themedir);
+    bool readBackground(RowSink* sink);
+    Pixmap renderBackground();
+
+    State state;
+    // Waits for the server, sessions, signals and timers
+    EventLoop* events;
+    // Set when the server is ready or exited while starting
+    bool serverWakeup;
+    // The session couldn't start, which the next panel tells
+    bool loginFailed;
 
     bool firstlogin;
+    bool daemonized;
     bool daemonmode;
     bool force_nodaemon;
 	// For testing themes
@@ -109,9 +145,9 @@ private:
     bool testing;
     
     std::string themeName;
-    std::string mcookie;
-
+    // Before mcookie, whose length it gives
     const int mcookiesize;
+    std::string mcookie;
 };
 
 
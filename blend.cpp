@@ -0,0 +1,225 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstring>
+
+#include "blend.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BLEND_AVX2
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* Pixels checked at once for being fully opaque or transparent */
+#define BLOCK 16
+
+/* The kernels blend n pixels. With t = a * x + (255 - a) * y,
+ * (t + 128 + ((t + 128) >> 8)) >> 8 is exactly (t + 127) / 255 for
+ * every t that can occur.
+ */
+typedef void (*BlendFunc)(const unsigned char *fg, const unsigned char *bg,
+                          unsigned char *out, const int n);
+
+static void
+blend_c(const unsigned char *fg, const unsigned char *bg,
+        unsigned char *out, const int n)
+{
+    for (int i = 0; i < n; i++, fg += 4, bg += 4, out += 4) {
+        const unsigned int a = fg[3];
+        for (int k = 0; k < 3; k++) {
+            unsigned int t = a * fg[k] + (255 - a) * bg[k] + 128;
+            out[k] = (unsigned char) ((t + (t >> 8)) >> 8);
+        }
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128i
+blend8_sse2(__m128i fg, __m128i a, __m128i bg)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, fg),
+                              _mm_mullo_epi16(_mm_sub_epi16(max, a), bg));
+    t = _mm_add_epi16(t, round);
+    return(_mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8));
+}
+
+static void
+blend_sse2(const unsigned char *fg, const unsigned char *bg,
+           unsigned char *out, const int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i f = _mm_loadu_si128((const __m128i *) (fg + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (bg + 4 * i));
+        // Spread each alpha over the bytes of its pixel
+        __m128i a = _mm_srli_epi32(f, 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i lo = blend8_sse2(_mm_unpacklo_epi8(f, zero),
+                                 _mm_unpacklo_epi8(a, zero),
+                                 _mm_unpacklo_epi8(b, zero));
+        __m128i hi = blend8_sse2(_mm_unpackhi_epi8(f, zero),
+                                 _mm_unpackhi_epi8(a, zero),
+                                 _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128((__m128i *) (out + 4 * i),
+                         _mm_packus_epi16(lo, hi));
+    }
+    blend_c(fg + 4 * i, bg + 4 * i, out + 4 * i, n - i);
+}
+#endif
+
+#ifdef BLEND_AVX2
+__attribute__((target("avx2"))) static inline __m256i
+blend16_avx2(__m256i fg, __m256i a, __m256i bg)
+{
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i round = _mm256_set1_epi16(128);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, fg),
+                                 _mm256_mullo_epi16(_mm256_sub_epi16(max, a),
+                                                    bg));
+    t = _mm256_add_epi16(t, round);
+    return(_mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)),
+                             8));
+}
+
+__attribute__((target("avx2"))) static void
+blend_avx2(const unsigned char *fg, const unsigned char *bg,
+           unsigned char *out, const int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i f = _mm256_loadu_si256((const __m256i *) (fg + 4 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (bg + 4 * i));
+        __m256i a = _mm256_srli_epi32(f, 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        // unpack and packus both work per 128 bit lane, so the bytes
+        // come back out in their original order
+        __m256i lo = blend16_avx2(_mm256_unpacklo_epi8(f, zero),
+                                  _mm256_unpacklo_epi8(a, zero),
+                                  _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = blend16_avx2(_mm256_unpackhi_epi8(f, zero),
+                                  _mm256_unpackhi_epi8(a, zero),
+                                  _mm256_unpackhi_epi8(b, zero));
+        _mm256_storeu_si256((__m256i *) (out + 4 * i),
+                            _mm256_packus_epi16(lo, hi));
+    }
+#ifdef __SSE2__
+    blend_sse2(fg + 4 * i, bg + 4 * i, out + 4 * i, n - i);
+#else
+    blend_c(fg + 4 * i, bg + 4 * i, out + 4 * i, n - i);
+#endif
+}
+#endif
+
+#ifdef __ARM_NEON
+static inline uint8x8_t
+blend8_neon(uint8x8_t fg, uint8x8_t a, uint8x8_t bg)
+{
+    uint16x8_t t = vmull_u8(a, fg);
+    t = vmlal_u8(t, vsub_u8(vdup_n_u8(255), a), bg);
+    // Rounding shifts give the same exact division by 255
+    return(vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8));
+}
+
+static void
+blend_neon(const unsigned char *fg, const unsigned char *bg,
+           unsigned char *out, const int n)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t f = vld4_u8(fg + 4 * i);
+        uint8x8x4_t b = vld4_u8(bg + 4 * i);
+        for (int k = 0; k < 3; k++)
+            f.val[k] = blend8_neon(f.val[k], f.val[3], b.val[k]);
+        vst4_u8(out + 4 * i, f);
+    }
+    blend_c(fg + 4 * i, bg + 4 * i, out + 4 * i, n - i);
+}
+#endif
+
+static BlendFunc
+pickBlend()
+{
+#ifdef BLEND_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return blend_avx2;
+#endif
+#ifdef __SSE2__
+    return blend_sse2;
+#elif defined(__ARM_NEON)
+    return blend_neon;
+#else
+    return blend_c;
+#endif
+}
+static const BlendFunc blend = pickBlend();
+
+enum BlockKind { TRANSPARENT, OPAQUE, MIXED };
+
+static inline BlockKind
+blockKind(const unsigned char *fg)
+{
+    unsigned char all = 0xff, any = 0;
+    for (int i = 0; i < BLOCK; i++) {
+        all &= fg[4*i + 3];
+        any |= fg[4*i + 3];
+    }
+    if (all == 0xff)
+        return OPAQUE;
+    if (any == 0)
+        return TRANSPARENT;
+    return MIXED;
+}
+
+void
+BlendRow(const unsigned char *fg, const unsigned char *bg,
+         unsigned char *out, const int n)
+{
+    int i = 0;
+
+    while (i < n) {
+        if (i + BLOCK > n) {
+            blend(fg + 4 * i, bg + 4 * i, out + 4 * i, n - i);
+            break;
+        }
+
+        BlockKind kind = blockKind(fg + 4 * i);
+        if (kind == MIXED) {
+            // Blend the following partly transparent blocks at once
+            int run = BLOCK;
+            while (i + run + BLOCK <= n
+                   && blockKind(fg + 4 * (i + run)) == MIXED)
+                run += BLOCK;
+            blend(fg + 4 * i, bg + 4 * i, out + 4 * i, run);
+            i += run;
+            continue;
+        }
+
+        const unsigned char *src = (kind == OPAQUE) ? fg : bg;
+        if (src != out)
+            memcpy(out + 4 * i, src + 4 * i, 4 * BLOCK);
+        i += BLOCK;
+    }
+}
@@ -0,0 +1,20 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _BLEND_H_
+#define _BLEND_H_
+
+/* Blend n RGBA pixels of fg over bg into out, weighting fg by its
+ * alpha: out = (a * fg + (255 - a) * bg + 127) / 255, exactly. The
+ * alpha left in out is meaningless. out may be the same buffer as fg
+ * or bg.
+ */
+void BlendRow(const unsigned char *fg, const unsigned char *bg,
+              unsigned char *out, const int n);
+
+#endif
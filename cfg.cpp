@@ -57,6 +57,10 @@ Cfg::Cfg()
     options.insert(option("sessiondir",""));
     options.insert(option("hidecursor","false"));
     options.insert(option("allow_exit", "true"));
+    options.insert(option("threads", "auto"));
+    options.insert(option("cache_dir", "/var/cache/slim"));
+    options.insert(option("xrender", "false"));
+    options.insert(option("keep_xserver", "false"));
 
     // Theme stuff
     options.insert(option("input_panel_x","50%"));
@@ -44,6 +44,9 @@
 /* variables replaced in pre-session_cmd and post-session_cmd */
 #define USER_VAR       "%user"
 
+/* time the X server gets to accept connections, in milliseconds */
+#define SERVER_START_TIMEOUT  120000
+
 /* max height/width for images */
 #define MAX_DIMENSION 10000
 
@@ -0,0 +1,281 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "eventloop.h"
+#include "util.h"
+#include "log.h"
+
+using namespace std;
+
+EventLoop::EventLoop() : sigfd(-1) {
+    sigemptyset(&signals);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        logStream << APPNAME << ": epoll_create1: " << strerror(errno)
+                  << endl;
+}
+
+EventLoop::~EventLoop() {
+    // Everything but watched descriptors belongs to the loop
+    map<int, Handler>::iterator it;
+    for (it = handlers.begin(); it != handlers.end(); ++it)
+        if (it->second.kind != KIND_FD)
+            close(it->first);
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+    if (epfd >= 0)
+        close(epfd);
+}
+
+void
+EventLoop::add(int fd, Kind kind, Callback cb, void* data, int what) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    // The descriptor may be a new one under a number that was closed
+    // without being unwatched
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0
+        && (errno != EEXIST
+            || epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event) < 0))
+    {
+        logStream << APPNAME << ": epoll_ctl: " << strerror(errno) << endl;
+        return;
+    }
+
+    Handler handler = { kind, cb, data, what };
+    handlers[fd] = handler;
+}
+
+void
+EventLoop::remove(int fd) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    handlers.erase(fd);
+}
+
+void
+EventLoop::Watch(int fd, Callback cb, void* data) {
+    add(fd, KIND_FD, cb, data, fd);
+}
+
+void
+EventLoop::Unwatch(int fd) {
+    map<int, Handler>::iterator it = handlers.find(fd);
+    if (it != handlers.end() && it->second.kind == KIND_FD)
+        remove(fd);
+}
+
+int
+EventLoop::AddTimer(int msecs, Callback cb, void* data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = msecs / 1000;
+    spec.it_value.tv_nsec = (msecs % 1000) * 1000000L;
+    // A zero time would disarm the timer
+    if (msecs <= 0) {
+        spec.it_value.tv_sec = 0;
+        spec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    add(fd, KIND_TIMER, cb, data, fd);
+    return fd;
+}
+
+void
+EventLoop::RemoveTimer(int timer) {
+    map<int, Handler>::iterator it = handlers.find(timer);
+    if (it != handlers.end() && it->second.kind == KIND_TIMER) {
+        remove(timer);
+        close(timer);
+    }
+}
+
+void
+EventLoop::WatchSignal(int sig, Callback cb, void* data) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    sigaddset(&signals, sig);
+
+    // Given the descriptor, signalfd changes its set of signals
+    int fd = signalfd(sigfd, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        logStream << APPNAME << ": signalfd: " << strerror(errno) << endl;
+    } else if (sigfd < 0) {
+        sigfd = fd;
+        add(sigfd, KIND_SIGNAL, NULL, NULL, sigfd);
+    }
+
+    Handler handler = { KIND_SIGNAL, cb, data, sig };
+    signalHandlers[sig] = handler;
+}
+
+void
+EventLoop::UnwatchSignal(int sig) {
+    if (signalHandlers.erase(sig) == 0)
+        return;
+
+    sigdelset(&signals, sig);
+    if (sigfd >= 0)
+        signalfd(sigfd, &signals, 0);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+void
+EventLoop::WatchExit(pid_t pid, Callback cb, void* data) {
+    if (pid <= 0)
+        return;
+
+#ifdef SYS_pidfd_open
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd >= 0) {
+        add(fd, KIND_EXIT, cb, data, pid);
+        return;
+    }
+#endif
+
+    if (exitHandlers.empty())
+        WatchSignal(SIGCHLD, childSignal, this);
+    Handler handler = { KIND_EXIT, cb, data, pid };
+    exitHandlers[pid] = handler;
+}
+
+void
+EventLoop::UnwatchExit(pid_t pid) {
+    map<int, Handler>::iterator it;
+    for (it = handlers.begin(); it != handlers.end(); ++it) {
+        if (it->second.kind == KIND_EXIT && it->second.what == pid) {
+            int fd = it->first;
+            remove(fd);
+            close(fd);
+            break;
+        }
+    }
+
+    if (exitHandlers.erase(pid) > 0 && exitHandlers.empty())
+        UnwatchSignal(SIGCHLD);
+}
+
+/* Any child may have exited */
+void
+EventLoop::childSignal(void* data, int) {
+    EventLoop* loop = static_cast<EventLoop*>(data);
+    // The handlers may unwatch themselves
+    map<int, Handler> exits = loop->exitHandlers;
+    map<int, Handler>::iterator it;
+    for (it = exits.begin(); it != exits.end(); ++it)
+        it->second.cb(it->second.data, it->first);
+}
+
+void
+EventLoop::readSignals() {
+    struct signalfd_siginfo info;
+    while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+        map<int, Handler>::iterator it = signalHandlers.find(info.ssi_signo);
+        if (it != signalHandlers.end()) {
+            Handler handler = it->second;
+            handler.cb(handler.data, info.ssi_signo);
+        }
+    }
+}
+
+void
+EventLoop::RunOnce(int msecs) {
+    struct epoll_event events[16];
+    int n = epoll_wait(epfd, events, 16, msecs);
+
+    for (int i = 0; i < n; i++) {
+        // An earlier handler may have removed this one
+        int fd = events[i].data.fd;
+        map<int, Handler>::iterator it = handlers.find(fd);
+        if (it == handlers.end())
+            continue;
+
+        Handler handler = it->second;
+        switch (handler.kind) {
+        case KIND_FD:
+            handler.cb(handler.data, fd);
+            break;
+        case KIND_TIMER: {
+            // Not expired if the number was reused by a new timer
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) < 0)
+                break;
+            remove(fd);
+            close(fd);
+            handler.cb(handler.data, fd);
+            break;
+        }
+        case KIND_SIGNAL:
+            readSignals();
+            break;
+        case KIND_EXIT:
+            handler.cb(handler.data, handler.what);
+            break;
+        }
+    }
+}
+
+void
+EventLoop::RunUntil(const bool* done, int msecs) {
+    const long long deadline = Util::msecs() + msecs;
+    while (!*done) {
+        int timeout = -1;
+        if (msecs >= 0) {
+            long long remaining = deadline - Util::msecs();
+            if (remaining <= 0)
+                break;
+            timeout = (int) remaining;
+        }
+        RunOnce(timeout);
+    }
+}
+
+void
+EventLoop::Wait(int msecs) {
+    bool never = false;
+    RunUntil(&never, msecs);
+}
+
+int
+EventLoop::System(const char* command) {
+    sigset_t saved;
+    sigprocmask(SIG_UNBLOCK, &signals, &saved);
+    int status = system(command);
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    return status;
+}
+
+void
+EventLoop::ResetChild() {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
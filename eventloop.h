@@ -0,0 +1,103 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _EVENTLOOP_H_
+#define _EVENTLOOP_H_
+
+#include <map>
+#include <signal.h>
+#include <sys/types.h>
+
+/* Waits on descriptors, timers, signals and child processes at once,
+ * with epoll, and calls back the handler of whatever happened. Handlers
+ * may add and remove watches, and run the loop again themselves.
+ */
+class EventLoop {
+public:
+    /* Gets the data given with the watch, and the descriptor, timer,
+     * signal or pid it is about */
+    typedef void (*Callback)(void* data, int what);
+
+    EventLoop();
+    ~EventLoop();
+
+    /* Call cb whenever fd is readable, until unwatched */
+    void Watch(int fd, Callback cb, void* data);
+    void Unwatch(int fd);
+
+    /* Call cb once, msecs from now; the timer is gone when it is
+     * called. -1 on failure. */
+    int AddTimer(int msecs, Callback cb, void* data);
+    void RemoveTimer(int timer);
+
+    /* Call cb for sig, which stays blocked until it is unwatched and is
+     * read from a signalfd; a signal sent meanwhile waits for the loop.
+     * Unwatching lets a pending one go to the disposition of sig.
+     */
+    void WatchSignal(int sig, Callback cb, void* data);
+    void UnwatchSignal(int sig);
+
+    /* Call cb when the child pid exits, until unwatched; it doesn't
+     * reap the child. Without pidfds, cb is called on every SIGCHLD,
+     * so check with waitpid.
+     */
+    void WatchExit(pid_t pid, Callback cb, void* data);
+    void UnwatchExit(pid_t pid);
+
+    /* Wait up to msecs, or without limit if negative, and call the
+     * handlers of what happened */
+    void RunOnce(int msecs);
+    /* Handle events until *done is set, or msecs pass if not negative */
+    void RunUntil(const bool* done, int msecs = -1);
+    /* Handle events for msecs */
+    void Wait(int msecs);
+
+    /* system(), with the signals of the loop unblocked meanwhile, so
+     * that the command gets them as usual */
+    int System(const char* command);
+
+    /* Let a child about to exec get every signal again */
+    static void ResetChild();
+
+private:
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+
+    enum Kind {
+        KIND_FD,
+        KIND_TIMER,
+        KIND_SIGNAL,    // the signalfd
+        KIND_EXIT       // a pidfd
+    };
+
+    struct Handler {
+        Kind kind;
+        Callback cb;
+        void* data;
+        // The pid of a pidfd
+        int what;
+    };
+
+    void add(int fd, Kind kind, Callback cb, void* data, int what);
+    void remove(int fd);
+    void readSignals();
+    static void childSignal(void* data, int sig);
+
+    int epfd;
+    // By descriptor
+    std::map<int, Handler> handlers;
+
+    int sigfd;
+    sigset_t signals;
+    std::map<int, Handler> signalHandlers;
+
+    // Exits watched through SIGCHLD, by pid
+    std::map<int, Handler> exitHandlers;
+};
+
+#endif
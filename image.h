@@ -18,62 +18,78 @@
 #include <X11/Xlib.h>
 #include <X11/Xmu/WinUtil.h>
 #include "log.h"
+#include "scaler.h"
+#include "pixelbuffer.h"
+#include "imageop.h"
 
+/* Resize, Crop, Tile, Center, Plain and Merge only record what is to
+ * be done; the pixels are computed in one pass over the final rows
+ * when they are needed.
+ */
 class Image {
 public:
     Image();
     Image(const int w, const int h, const unsigned char *rgb,
           const unsigned char *alpha);
+    /* Shows the pixels of shared, which must not change or go away
+     * while this image is in use */
+    explicit Image(const Image *shared);
 
     ~Image();
 
-    const unsigned char * getPNGAlpha() const {
-        return(png_alpha);
+    /* Interleaved pixels in Order(), alpha only meaningful if
+     * HasAlpha(); computes the pending operations.
+     */
+    const PixelBuffer& Pixels();
+    bool HasAlpha() const {
+        return(op != NULL && op->HasAlpha());
     };
-    const unsigned char * getRGBData() const {
-        return(rgb_data);
+    ChannelOrder Order() const {
+        return(op != NULL ? op->Order() : ORDER_RGBA);
     };
 
-    void getPixel(double px, double py, unsigned char *pixel);
-    void getPixel(double px, double py, unsigned char *pixel,
-                  unsigned char *alpha);
-
     int Width() const  {
-        return(width);
+        return(op != NULL ? op->Width() : 0);
     };
     int Height() const {
-        return(height);
+        return(op != NULL ? op->Height() : 0);
     };
     void Quality(const int q) {
         quality_ = q;
     };
 
-    bool Read(const char *filename);
+    /* A JPEG only needed at min_w x min_h or less may be decoded
+     * smaller than its full size. Decoding in the order the pixels end
+     * up in saves converting them later. */
+    bool Read(const char *filename, const int min_w = 0,
+              const int min_h = 0, const ChannelOrder order = ORDER_RGBA);
 
     void Reduce(const int factor);
     void Resize(const int w, const int h);
+    /* Takes over the pixels of background, leaving it empty, unless
+     * either image is empty or this one doesn't fit on background */
     void Merge(Image* background, const int x, const int y);
     void Crop(const int x, const int y, const int w, const int h);
     void Tile(const int w, const int h);
     void Center(const int w, const int h, const char *hex);
     void Plain(const int w, const int h, const char *hex);
-    
-    void computeShift(unsigned long mask, unsigned char &left_shift,
-                      unsigned char &right_shift);
+
+    /* Hand every row to sink, several at a time, computing each one
+     * from the source pixels and swapping red and blue if the sink
+     * wants the other order */
+    void PutRows(RowSink *sink) const;
 
     Pixmap createPixmap(Display* dpy, int scr, Window win);
 
 private:
-    int width, height, area;
-    unsigned char *rgb_data;
-    unsigned char *png_alpha;
+    Image(const Image&);
+    Image& operator=(const Image&);
 
-    int quality_;
+    void set(ImageOp *new_op);
 
-    int readJpeg(const char *filename, int *width, int *height,
-        unsigned char **rgb);
-    int readPng(const char *filename, int *width, int *height,
-        unsigned char **rgb, unsigned char **alpha);
+    ImageOp *op;
+
+    int quality_;
 };
 
 #endif
@@ -0,0 +1,139 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "imagecache.h"
+#include "log.h"
+
+using namespace std;
+
+// 64 bit FNV-1a
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+ImageCache::ImageCache(const string& dir, const string& name)
+    : dir(dir), name(name), hash(FNV_OFFSET)
+{
+    Add(name);
+}
+
+void
+ImageCache::Add(const string& value) {
+    // Include the terminating NUL so that "ab","c" != "a","bc"
+    for (string::size_type i = 0; i <= value.size(); i++) {
+        hash ^= (unsigned char) value.c_str()[i];
+        hash *= FNV_PRIME;
+    }
+}
+
+void
+ImageCache::Add(const int value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", value);
+    Add(string(buf));
+}
+
+void
+ImageCache::AddFile(const string& path) {
+    struct stat st;
+    Add(path);
+    if (stat(path.c_str(), &st) < 0) {
+        Add("-");
+        return;
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%lld %lld",
+             (long long) st.st_size, (long long) st.st_mtime);
+    Add(string(buf));
+}
+
+void
+ImageCache::AddScreen(Display *dpy, int scr) {
+    Visual *visual = DefaultVisual(dpy, scr);
+    Add(XWidthOfScreen(ScreenOfDisplay(dpy, scr)));
+    Add(XHeightOfScreen(ScreenOfDisplay(dpy, scr)));
+    Add(DefaultDepth(dpy, scr));
+    Add((int) visual->red_mask);
+    Add((int) visual->green_mask);
+    Add((int) visual->blue_mask);
+}
+
+string
+ImageCache::key() const {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", hash);
+    return(string(buf));
+}
+
+string
+ImageCache::Path() const {
+    if (dir.empty())
+        return(string());
+    return(dir + "/" + name + "-" + key());
+}
+
+XImageBuffer *
+ImageCache::Load(Display *dpy, int scr) const {
+    if (dir.empty())
+        return(NULL);
+
+    XImageBuffer *buffer = new XImageBuffer(dpy, scr, Path().c_str(),
+                                            key().c_str());
+    if (!buffer->Valid()) {
+        delete buffer;
+        return(NULL);
+    }
+    return(buffer);
+}
+
+void
+ImageCache::Save(const XImageBuffer& buffer) const {
+    if (dir.empty() || !buffer.Valid())
+        return;
+
+    mkdir(dir.c_str(), 0755);
+    if (!buffer.Save(Path().c_str(), key().c_str())) {
+        logStream << APPNAME << ": could not write image cache "
+                  << Path() << endl;
+        return;
+    }
+    Prune();
+}
+
+void
+ImageCache::Prune() const {
+    if (dir.empty())
+        return;
+
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return;
+
+    // Entries of this name are name-<16 hex digits>
+    const string prefix = name + "-";
+    const string current = key();
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *file = entry->d_name;
+        if (strncmp(file, prefix.c_str(), prefix.size()) != 0)
+            continue;
+        const char *k = file + prefix.size();
+        if (strlen(k) != current.size()
+            || strspn(k, "0123456789abcdef") != current.size()
+            || current == k)
+            continue;
+        unlink((dir + "/" + file).c_str());
+    }
+    closedir(d);
+}
@@ -0,0 +1,52 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include <string>
+#include <X11/Xlib.h>
+#include "ximagebuffer.h"
+
+/* Converted pixels kept in a directory between runs.
+ * Everything the pixels depend on is added to the key before Load or
+ * Save; a changed input gives a different file, and saving it removes
+ * the files of other keys under the same name. The directory may be
+ * emptied at any time. Other data kept the same way can be written to
+ * Path(), followed by Prune().
+ */
+class ImageCache {
+public:
+    /* An empty dir disables the cache */
+    ImageCache(const std::string& dir, const std::string& name);
+
+    void Add(const std::string& value);
+    void Add(const int value);
+    /* Path, size and modification time of a file, if it exists */
+    void AddFile(const std::string& path);
+    /* Geometry and pixel format of a screen */
+    void AddScreen(Display *dpy, int scr);
+
+    /* NULL if there is no usable entry */
+    XImageBuffer *Load(Display *dpy, int scr) const;
+    void Save(const XImageBuffer& buffer) const;
+
+    /* The file of the key, empty if the cache is disabled */
+    std::string Path() const;
+    /* Remove the files of this name kept for other keys */
+    void Prune() const;
+
+private:
+    std::string key() const;
+
+    std::string dir;
+    std::string name;
+    unsigned long long hash;
+};
+
+#endif
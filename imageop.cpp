@@ -0,0 +1,425 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstring>
+#include <utility>
+
+#include "imageop.h"
+#include "threadpool.h"
+#include "blend.h"
+
+/* Repeat the first size bytes of buf until it holds total bytes,
+ * doubling the copied part each time.
+ */
+static void
+replicate(unsigned char *buf, const int size, const int total) {
+    int done = size;
+    while (done < total) {
+        const int n = done < total - done ? done : total - done;
+        memcpy(buf + done, buf, n);
+        done += n;
+    }
+}
+
+class SourceReader : public RowReader {
+public:
+    SourceReader(const PixelBuffer *pixels, const int x)
+        : pixels(pixels), x(x) {};
+
+    const unsigned char *Row(const int y) {
+        return(pixels->Row(y) + 4 * x);
+    };
+
+private:
+    const PixelBuffer *pixels;
+    int x;
+};
+
+class SwapReader : public RowReader {
+public:
+    SwapReader(RowReader *src, const int w)
+        : src(src), w(w), out(new unsigned char[4 * w]) {};
+    ~SwapReader() {
+        delete src;
+        delete [] out;
+    };
+
+    const unsigned char *Row(const int y) {
+        const unsigned char *in = src->Row(y);
+        unsigned char *p = out;
+        for (int i = 0; i < w; i++, in += 4, p += 4) {
+            p[0] = in[2];
+            p[1] = in[1];
+            p[2] = in[0];
+            p[3] = in[3];
+        }
+        return(out);
+    };
+
+private:
+    RowReader *src;
+    int w;
+    unsigned char *out;
+};
+
+class ScaleReader : public RowReader {
+public:
+    ScaleReader(const Scaler *scaler, RowReader *src, const int x,
+                const int w);
+    ~ScaleReader();
+
+    const unsigned char *Row(const int y);
+
+private:
+    const Scaler *scaler;
+    // Reads the source columns under [x, x + w)
+    RowReader *src;
+    int x, w;
+    // Horizontally scaled source rows; consecutive destination rows
+    // mostly share one or both of them, so keep the last two around
+    short *rows[2];
+    int cached[2];
+    unsigned char *out;
+};
+
+ScaleReader::ScaleReader(const Scaler *scaler, RowReader *src,
+                         const int x, const int w)
+    : scaler(scaler), src(src), x(x), w(w)
+{
+    rows[0] = new short[8 * w];
+    rows[1] = rows[0] + 4 * w;
+    cached[0] = cached[1] = -1;
+    out = new unsigned char[4 * w];
+}
+
+ScaleReader::~ScaleReader() {
+    delete src;
+    delete [] rows[0];
+    delete [] out;
+}
+
+const unsigned char *
+ScaleReader::Row(const int y) {
+    const int s0 = scaler->FirstRow(y);
+    const int s1 = scaler->LastRow(y);
+    short *h0, *h1;
+
+    if (cached[0] == s0) {
+        h0 = rows[0];
+    } else if (cached[1] == s0) {
+        h0 = rows[1];
+    } else {
+        const int slot = (cached[0] == s1) ? 1 : 0;
+        scaler->Horizontal(src->Row(s0), x, x + w, rows[slot]);
+        cached[slot] = s0;
+        h0 = rows[slot];
+    }
+
+    if (s1 == s0) {
+        h1 = h0;
+    } else if (cached[0] == s1) {
+        h1 = rows[0];
+    } else if (cached[1] == s1) {
+        h1 = rows[1];
+    } else {
+        const int slot = (h0 == rows[0]) ? 1 : 0;
+        scaler->Horizontal(src->Row(s1), x, x + w, rows[slot]);
+        cached[slot] = s1;
+        h1 = rows[slot];
+    }
+
+    scaler->Vertical(h0, h1, y, w, out);
+    return(out);
+}
+
+class CropReader : public RowReader {
+public:
+    CropReader(RowReader *src, const int y) : src(src), y(y) {};
+    ~CropReader() {
+        delete src;
+    };
+
+    const unsigned char *Row(const int row) {
+        return(src->Row(y + row));
+    };
+
+private:
+    RowReader *src;
+    int y;
+};
+
+class TileReader : public RowReader {
+public:
+    TileReader(RowReader *src, const int src_width, const int src_height,
+               const int x, const int w)
+        : src(src), src_width(src_width), src_height(src_height),
+          x(x), w(w), out(new unsigned char[4 * w]) {};
+    ~TileReader() {
+        delete src;
+        delete [] out;
+    };
+
+    const unsigned char *Row(const int y);
+
+private:
+    RowReader *src;
+    int src_width, src_height;
+    int x, w;
+    unsigned char *out;
+};
+
+const unsigned char *
+TileReader::Row(const int y) {
+    const unsigned char *srow = src->Row(y % src_height);
+    int offset = x % src_width;
+
+    // Within one tile, the source row will do
+    if (offset + w <= src_width)
+        return(srow + 4 * offset);
+
+    int done = 0;
+    while (done < w) {
+        int n = src_width - offset;
+        if (n > w - done)
+            n = w - done;
+        memcpy(out + 4 * done, srow + 4 * offset, 4 * n);
+        done += n;
+        offset = 0;
+    }
+    return(out);
+}
+
+class PlaceReader : public RowReader {
+public:
+    PlaceReader(RowReader *src, const int src_height, const bool alpha,
+                const int x0, const int x1, const int y,
+                const unsigned char *color, const int w);
+    ~PlaceReader();
+
+    const unsigned char *Row(const int row);
+
+private:
+    RowReader *src;
+    int src_height;
+    bool alpha;
+    // Columns [x0, x1) of the row show src, from row y on
+    int x0, x1;
+    int y;
+    int w;
+    unsigned char *color_row;
+    unsigned char *out;
+};
+
+PlaceReader::PlaceReader(RowReader *src, const int src_height,
+                         const bool alpha, const int x0, const int x1,
+                         const int y, const unsigned char *color,
+                         const int w)
+    : src(src), src_height(src_height), alpha(alpha), x0(x0), x1(x1),
+      y(y), w(w), out(NULL)
+{
+    color_row = new unsigned char[4 * w];
+    memcpy(color_row, color, 4);
+    replicate(color_row, 4, 4 * w);
+    if (src != NULL)
+        out = new unsigned char[4 * w];
+}
+
+PlaceReader::~PlaceReader() {
+    delete src;
+    delete [] color_row;
+    delete [] out;
+}
+
+const unsigned char *
+PlaceReader::Row(const int row) {
+    if (src == NULL || row < y || row >= y + src_height)
+        return(color_row);
+
+    const unsigned char *srow = src->Row(row - y);
+    if (!alpha && x0 == 0 && x1 == w)
+        return(srow);
+
+    // Only the margins show the color
+    memcpy(out, color_row, 4 * x0);
+    memcpy(out + 4 * x1, color_row, 4 * (w - x1));
+    if (alpha)
+        BlendRow(srow, color_row, out + 4 * x0, x1 - x0);
+    else
+        memcpy(out + 4 * x0, srow, 4 * (x1 - x0));
+    return(out);
+}
+
+class BlendReader : public RowReader {
+public:
+    BlendReader(RowReader *fg, RowReader *bg, const int y, const int w)
+        : fg(fg), bg(bg), y(y), w(w), out(new unsigned char[4 * w]) {};
+    ~BlendReader() {
+        delete fg;
+        delete bg;
+        delete [] out;
+    };
+
+    const unsigned char *Row(const int row) {
+        BlendRow(fg->Row(row), bg->Row(y + row), out, w);
+        return(out);
+    };
+
+private:
+    RowReader *fg;
+    RowReader *bg;
+    int y, w;
+    unsigned char *out;
+};
+
+struct RunJob {
+    const ImageOp *op;
+    RowSink *sink;
+};
+
+static void
+runRows(void *data, const int y0, const int y1) {
+    RunJob *job = static_cast<RunJob*>(data);
+    RowReader *reader = job->op->Open(0, job->op->Width());
+    for (int y = y0; y < y1; y++)
+        job->sink->PutRow(y, reader->Row(y));
+    delete reader;
+}
+
+void
+ImageOp::Run(RowSink *sink) const {
+    if (width <= 0 || height <= 0)
+        return;
+
+    RunJob job = { this, sink };
+    ThreadPool::ForRows(height, width, runRows, &job);
+}
+
+SourceOp::SourceOp(PixelBuffer&& buffer, const bool alpha,
+                   const ChannelOrder order)
+    : ImageOp(buffer.Width(), buffer.Height(), alpha, order),
+      pixels(std::move(buffer))
+{
+}
+
+RowReader *
+SourceOp::Open(const int x, const int) const {
+    return(new SourceReader(&pixels, x));
+}
+
+SwapOp::SwapOp(ImageOp *src)
+    : ImageOp(src->Width(), src->Height(), src->HasAlpha(),
+              src->Order() == ORDER_RGBA ? ORDER_BGRA : ORDER_RGBA),
+      src(src)
+{
+}
+
+SwapOp::~SwapOp() {
+    delete src;
+}
+
+RowReader *
+SwapOp::Open(const int x, const int w) const {
+    return(new SwapReader(src->Open(x, w), w));
+}
+
+ScaleOp::ScaleOp(ImageOp *src, const int w, const int h)
+    : ImageOp(w, h, src->HasAlpha(), src->Order()), src(src),
+      scaler(src->Width(), src->Height(), w, h, 4)
+{
+}
+
+ScaleOp::~ScaleOp() {
+    delete src;
+}
+
+RowReader *
+ScaleOp::Open(const int x, const int w) const {
+    const int first = scaler.FirstColumn(x);
+    const int last = scaler.LastColumn(x + w - 1);
+    return(new ScaleReader(&scaler, src->Open(first, last - first + 1),
+                           x, w));
+}
+
+CropOp::CropOp(ImageOp *src, const int x, const int y, const int w,
+               const int h)
+    : ImageOp(w, h, src->HasAlpha(), src->Order()), src(src), x(x), y(y)
+{
+}
+
+CropOp::~CropOp() {
+    delete src;
+}
+
+RowReader *
+CropOp::Open(const int col, const int w) const {
+    return(new CropReader(src->Open(x + col, w), y));
+}
+
+TileOp::TileOp(ImageOp *src, const int w, const int h)
+    : ImageOp(w, h, false, src->Order()), src(src)
+{
+}
+
+TileOp::~TileOp() {
+    delete src;
+}
+
+RowReader *
+TileOp::Open(const int x, const int w) const {
+    return(new TileReader(src->Open(0, src->Width()), src->Width(),
+                          src->Height(), x, w));
+}
+
+PlaceOp::PlaceOp(ImageOp *src, const int x, const int y, const int w,
+                 const int h, const unsigned char *c,
+                 const ChannelOrder order)
+    : ImageOp(w, h, false, src != NULL ? src->Order() : order), src(src),
+      x(x), y(y)
+{
+    memcpy(color, c, 4);
+    if (Order() == ORDER_BGRA) {
+        color[0] = c[2];
+        color[2] = c[0];
+    }
+}
+
+PlaceOp::~PlaceOp() {
+    delete src;
+}
+
+RowReader *
+PlaceOp::Open(const int col, const int w) const {
+    if (src == NULL || src->Width() <= 0)
+        return(new PlaceReader(NULL, 0, false, 0, 0, 0, color, w));
+
+    // The columns of the window showing src, if any
+    int x0 = x > col ? x : col;
+    int x1 = x + src->Width() < col + w ? x + src->Width() : col + w;
+    if (x1 <= x0)
+        return(new PlaceReader(NULL, 0, false, 0, 0, 0, color, w));
+
+    return(new PlaceReader(src->Open(x0 - x, x1 - x0), src->Height(),
+                           src->HasAlpha(), x0 - col, x1 - col, y,
+                           color, w));
+}
+
+BlendOp::BlendOp(ImageOp *fg, ImageOp *bg, const int x, const int y)
+    : ImageOp(fg->Width(), fg->Height(), false, fg->Order()), fg(fg), bg(bg),
+      x(x), y(y)
+{
+}
+
+BlendOp::~BlendOp() {
+    delete fg;
+    delete bg;
+}
+
+RowReader *
+BlendOp::Open(const int col, const int w) const {
+    return(new BlendReader(fg->Open(col, w), bg->Open(x + col, w), y, w));
+}
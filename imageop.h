@@ -0,0 +1,193 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _IMAGEOP_H_
+#define _IMAGEOP_H_
+
+#include "pixelbuffer.h"
+#include "scaler.h"
+
+/* Reads the 4 byte pixel rows of an ImageOp, w pixels from column x on. Readers
+ * keep the scratch rows of one band of rows, so every thread opens its
+ * own.
+ */
+class RowReader {
+public:
+    virtual ~RowReader() {};
+
+    /* Row y, valid until the next call */
+    virtual const unsigned char *Row(const int y) = 0;
+};
+
+/* A node of a lazily computed image: decoded pixels, or an operation
+ * on the nodes it owns. Nothing is computed until rows are read, and
+ * then every output pixel is computed once, straight from the source
+ * pixels.
+ */
+class ImageOp {
+public:
+    virtual ~ImageOp() {};
+
+    int Width() const {
+        return(width);
+    };
+    int Height() const {
+        return(height);
+    };
+    bool HasAlpha() const {
+        return(has_alpha);
+    };
+    ChannelOrder Order() const {
+        return(order);
+    };
+
+    /* The pixels if the node is a source, NULL otherwise */
+    virtual const PixelBuffer *Pixels() const {
+        return(NULL);
+    };
+
+    /* A reader of columns [x, x + w) */
+    virtual RowReader *Open(const int x, const int w) const = 0;
+
+    /* Hand every row to sink, several bands at a time */
+    void Run(RowSink *sink) const;
+
+protected:
+    ImageOp(const int w, const int h, const bool alpha,
+            const ChannelOrder order)
+        : width(w), height(h), has_alpha(alpha), order(order) {};
+
+    int width, height;
+    bool has_alpha;
+    ChannelOrder order;
+
+private:
+    ImageOp(const ImageOp&);
+    ImageOp& operator=(const ImageOp&);
+};
+
+/* Decoded pixels */
+class SourceOp : public ImageOp {
+public:
+    SourceOp(PixelBuffer&& pixels, const bool alpha,
+             const ChannelOrder order);
+
+    const PixelBuffer *Pixels() const {
+        return(&pixels);
+    };
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    PixelBuffer pixels;
+};
+
+/* Another node, not owned; it must outlive this one */
+class RefOp : public ImageOp {
+public:
+    RefOp(const ImageOp *op)
+        : ImageOp(op->Width(), op->Height(), op->HasAlpha(), op->Order()),
+          op(op) {};
+
+    const PixelBuffer *Pixels() const {
+        return(op->Pixels());
+    };
+    RowReader *Open(const int x, const int w) const {
+        return(op->Open(x, w));
+    };
+
+private:
+    const ImageOp *op;
+};
+
+/* src with red and blue exchanged, in the other channel order */
+class SwapOp : public ImageOp {
+public:
+    SwapOp(ImageOp *src);
+    ~SwapOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *src;
+};
+
+/* src stretched to w x h */
+class ScaleOp : public ImageOp {
+public:
+    ScaleOp(ImageOp *src, const int w, const int h);
+    ~ScaleOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *src;
+    Scaler scaler;
+};
+
+/* The (x, y, w, h) rectangle of src */
+class CropOp : public ImageOp {
+public:
+    CropOp(ImageOp *src, const int x, const int y, const int w,
+           const int h);
+    ~CropOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *src;
+    int x, y;
+};
+
+/* src repeated over w x h, without alpha */
+class TileOp : public ImageOp {
+public:
+    TileOp(ImageOp *src, const int w, const int h);
+    ~TileOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *src;
+};
+
+/* src placed at (x, y) on a w x h rectangle of the RGBA color, blended
+ * if it has alpha. src may be NULL, may be off the rectangle in part and
+ * the result has no alpha; it is in the channel order of src, or order
+ * without one.
+ */
+class PlaceOp : public ImageOp {
+public:
+    PlaceOp(ImageOp *src, const int x, const int y, const int w,
+            const int h, const unsigned char *color,
+            const ChannelOrder order = ORDER_RGBA);
+    ~PlaceOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *src;
+    int x, y;
+    unsigned char color[4];
+};
+
+/* fg blended over the part of bg at (x, y), without alpha; both are in
+ * the same channel order */
+class BlendOp : public ImageOp {
+public:
+    BlendOp(ImageOp *fg, ImageOp *bg, const int x, const int y);
+    ~BlendOp();
+
+    RowReader *Open(const int x, const int w) const;
+
+private:
+    ImageOp *fg;
+    ImageOp *bg;
+    int x, y;
+};
+
+#endif
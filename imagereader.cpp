@@ -0,0 +1,407 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   The decoding code has been adapted from xplanet 1.0.1,
+   Copyright (C) 2002-04 Hari Nair <hari@alumni.caltech.edu>
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "imagereader.h"
+#include "log.h"
+
+extern "C" {
+    #include <jpeglib.h>
+    #include <png.h>
+}
+
+class JpegReader : public ImageReader {
+public:
+    JpegReader();
+    ~JpegReader();
+
+    bool Open(const char *filename, const int min_width,
+              const int min_height, const ChannelOrder order);
+    bool ReadRow(unsigned char *rgba);
+
+private:
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    FILE *infile;
+    // Decoded row, unless libjpeg writes the pixels itself
+    unsigned char *row;
+    // Byte offsets of red and blue in a pixel
+    int red, blue;
+};
+
+class PngReader : public ImageReader {
+public:
+    PngReader();
+    ~PngReader();
+
+    bool Open(const char *filename, const ChannelOrder order);
+    bool ReadRow(unsigned char *rgba);
+    bool ReadImage(PixelBuffer *pixels);
+
+private:
+    bool readPasses(unsigned char *rows, const size_t stride);
+
+    png_structp png_ptr;
+    png_infop info_ptr;
+    FILE *infile;
+    int next_row;
+    int passes;
+    // An interlaced image read row by row is decoded completely first
+    unsigned char *pixels;
+};
+
+ImageReader *
+ImageReader::Open(const char *filename, const int min_width,
+                  const int min_height, const ChannelOrder order) {
+    char buf[4];
+    unsigned char *ubuf = (unsigned char *) buf;
+
+    FILE *file;
+    file = fopen(filename, "rb");
+    if (file == NULL)
+        return(NULL);
+
+    /* see what kind of file we have */
+
+    size_t n = fread(buf, 1, 4, file);
+    fclose(file);
+
+    if (n == 4 && (ubuf[0] == 0x89) && !strncmp("PNG", buf+1, 3)) {
+        PngReader *reader = new PngReader;
+        if (reader->Open(filename, order))
+            return(reader);
+        delete reader;
+    } else if (n >= 2 && (ubuf[0] == 0xff) && (ubuf[1] == 0xd8)) {
+        JpegReader *reader = new JpegReader;
+        if (reader->Open(filename, min_width, min_height, order))
+            return(reader);
+        delete reader;
+    } else {
+        logStream << APPNAME << ": Unknown image format: " << filename
+                  << endl;
+    }
+    return(NULL);
+}
+
+bool
+ImageReader::ReadImage(PixelBuffer *pixels) {
+    for (int j = 0; j < height; j++)
+        if (!ReadRow(pixels->Row(j)))
+            return(false);
+    return(true);
+}
+
+JpegReader::JpegReader() : infile(NULL), row(NULL), red(0), blue(2) {
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+}
+
+JpegReader::~JpegReader() {
+    jpeg_destroy_decompress(&cinfo);
+    if (infile != NULL)
+        fclose(infile);
+    free(row);
+}
+
+bool
+JpegReader::Open(const char *filename, const int min_width,
+                 const int min_height, const ChannelOrder order) {
+    infile = fopen(filename, "rb");
+    if (infile == NULL) {
+        logStream << APPNAME << ": Cannot fopen file: " << filename << endl;
+        return(false);
+    }
+
+    jpeg_stdio_src(&cinfo, infile);
+    jpeg_read_header(&cinfo, TRUE);
+
+    /* Let the IDCT do the bulk of a large downscale, leaving at most
+     * a factor of 2 to the scaler
+     */
+    if (min_width > 0 && min_height > 0) {
+        cinfo.scale_num = 1;
+        for (int denom = 8; denom > 1; denom /= 2) {
+            cinfo.scale_denom = denom;
+            jpeg_calc_output_dimensions(&cinfo);
+            if ((int) cinfo.output_width >= min_width
+                && (int) cinfo.output_height >= min_height)
+            {
+                break;
+            }
+            cinfo.scale_denom = 1;
+        }
+    }
+
+    if (order == ORDER_BGRA) {
+        red = 2;
+        blue = 0;
+    }
+
+#ifdef JCS_ALPHA_EXTENSIONS
+    /* libjpeg-turbo can produce the rows in the wanted order directly */
+    if (cinfo.jpeg_color_space == JCS_YCbCr
+        || cinfo.jpeg_color_space == JCS_RGB)
+    {
+        cinfo.out_color_space = (order == ORDER_BGRA) ? JCS_EXT_BGRA
+                                                      : JCS_EXT_RGBA;
+    }
+#endif
+
+    jpeg_start_decompress(&cinfo);
+
+    /* Prevent against integer overflow */
+    if(cinfo.output_width >= MAX_DIMENSION
+       || cinfo.output_height >= MAX_DIMENSION)
+    {
+        logStream << APPNAME << ": Unreasonable dimension found in file: "
+                  << filename << endl;
+        return(false);
+    }
+
+    switch (cinfo.out_color_space) {
+    case JCS_GRAYSCALE:
+    case JCS_RGB:
+    case JCS_CMYK:  // also what YCCK is decoded to
+        row = (unsigned char *) malloc(cinfo.output_width
+                                       * cinfo.output_components);
+        if (row == NULL) {
+            logStream << APPNAME << ": Can't allocate memory for JPEG file."
+                      << endl;
+            return(false);
+        }
+        break;
+#ifdef JCS_ALPHA_EXTENSIONS
+    case JCS_EXT_RGBA:
+    case JCS_EXT_BGRA:
+        break;
+#endif
+    default:
+        logStream << APPNAME << ": Unsupported JPEG color space in file: "
+                  << filename << endl;
+        return(false);
+    }
+
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    has_alpha = false;
+    return(true);
+}
+
+bool
+JpegReader::ReadRow(unsigned char *rgba) {
+    if (cinfo.output_scanline >= cinfo.output_height)
+        return(false);
+
+    if (row == NULL) {
+        jpeg_read_scanlines(&cinfo, &rgba, 1);
+        return(true);
+    }
+
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    const unsigned char *src = row;
+    if (cinfo.output_components == 1) {
+        for (int i = 0; i < width; i++, rgba += 4) {
+            memset(rgba, *src++, 3);
+            rgba[3] = 0xff;
+        }
+    } else if (cinfo.output_components == 3) {
+        for (int i = 0; i < width; i++, rgba += 4, src += 3) {
+            rgba[red] = src[0];
+            rgba[1] = src[1];
+            rgba[blue] = src[2];
+            rgba[3] = 0xff;
+        }
+    } else {
+        /* CMYK, which Adobe applications write inverted */
+        const unsigned char flip = cinfo.saw_Adobe_marker ? 0 : 0xff;
+        for (int i = 0; i < width; i++, rgba += 4, src += 4) {
+            const int k = src[3] ^ flip;
+            rgba[red] = (unsigned char) ((src[0] ^ flip) * k / 255);
+            rgba[1] = (unsigned char) ((src[1] ^ flip) * k / 255);
+            rgba[blue] = (unsigned char) ((src[2] ^ flip) * k / 255);
+            rgba[3] = 0xff;
+        }
+    }
+    return(true);
+}
+
+PngReader::PngReader()
+    : png_ptr(NULL), info_ptr(NULL), infile(NULL), next_row(0),
+      passes(1), pixels(NULL)
+{
+}
+
+PngReader::~PngReader() {
+    if (png_ptr != NULL)
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+    if (infile != NULL)
+        fclose(infile);
+    free(pixels);
+}
+
+bool
+PngReader::Open(const char *filename, const ChannelOrder order) {
+    png_uint_32 w, h;
+    int bit_depth, color_type, interlace_type;
+
+    infile = fopen(filename, "rb");
+    if (infile == NULL) {
+        logStream << APPNAME << ": Can not fopen file: " << filename << endl;
+        return(false);
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                     (png_voidp) NULL,
+                                     (png_error_ptr) NULL,
+                                     (png_error_ptr) NULL);
+    if (!png_ptr)
+        return(false);
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+        return(false);
+
+#if PNG_LIBPNG_VER_MAJOR >= 1 && PNG_LIBPNG_VER_MINOR >= 4
+    if (setjmp(png_jmpbuf((png_ptr)))) {
+#else
+    if (setjmp(png_ptr->jmpbuf)) {
+#endif
+        return(false);
+    }
+
+    png_init_io(png_ptr, infile);
+    png_read_info(png_ptr, info_ptr);
+
+    png_get_IHDR(png_ptr, info_ptr, &w, &h, &bit_depth, &color_type,
+                 &interlace_type, (int *) NULL, (int *) NULL);
+
+    /* Prevent against integer overflow */
+    if(w >= MAX_DIMENSION || h >= MAX_DIMENSION) {
+        logStream << APPNAME << ": Unreasonable dimension found in file: "
+                  << filename << endl;
+        return(false);
+    }
+
+    /* Change a paletted or low depth grayscale image to 8 bit,
+     * turning a tRNS chunk into an alpha channel
+     */
+    if (color_type == PNG_COLOR_TYPE_PALETTE
+        || (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        || png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+    {
+        png_set_expand(png_ptr);
+    }
+
+    /* Change a grayscale image to RGB */
+    if (color_type == PNG_COLOR_TYPE_GRAY
+        || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+    {
+        png_set_gray_to_rgb(png_ptr);
+    }
+
+    /* If the PNG file has 16 bits per channel, strip them down to 8 */
+    if (bit_depth == 16) {
+      png_set_strip_16(png_ptr);
+    }
+
+    /* use 1 byte per pixel */
+    png_set_packing(png_ptr);
+
+    has_alpha = (color_type & PNG_COLOR_MASK_ALPHA)
+                || png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS);
+
+    /* Give an image without alpha an opaque one */
+    if (!has_alpha)
+        png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
+
+    if (order == ORDER_BGRA)
+        png_set_bgr(png_ptr);
+
+    passes = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    if (png_get_channels(png_ptr, info_ptr) != 4) {
+        logStream << APPNAME << ": Unsupported PNG format in file: "
+                  << filename << endl;
+        return(false);
+    }
+
+    width = (int) w;
+    height = (int) h;
+    return(true);
+}
+
+/* Run every interlace pass over the rows, stride bytes apart; each pass
+ * fills in more pixels of rows decoded by the ones before.
+ */
+bool
+PngReader::readPasses(unsigned char *rows, const size_t stride) {
+#if PNG_LIBPNG_VER_MAJOR >= 1 && PNG_LIBPNG_VER_MINOR >= 4
+    if (setjmp(png_jmpbuf((png_ptr)))) {
+#else
+    if (setjmp(png_ptr->jmpbuf)) {
+#endif
+        return(false);
+    }
+    for (int pass = 0; pass < passes; pass++)
+        for (int j = 0; j < height; j++)
+            png_read_row(png_ptr, rows + j * stride, NULL);
+    return(true);
+}
+
+bool
+PngReader::ReadRow(unsigned char *rgba) {
+    if (next_row >= height)
+        return(false);
+
+    if (passes > 1) {
+        // Every pass touches all rows, so the rows can't be streamed
+        if (pixels == NULL) {
+            pixels = (unsigned char *) malloc((size_t) 4 * width * height);
+            if (pixels == NULL) {
+                logStream << APPNAME << ": Can't allocate memory for PNG "
+                          << "file." << endl;
+                return(false);
+            }
+            if (!readPasses(pixels, 4 * width))
+                return(false);
+        }
+        memcpy(rgba, pixels + (size_t) 4 * width * next_row, 4 * width);
+    } else {
+#if PNG_LIBPNG_VER_MAJOR >= 1 && PNG_LIBPNG_VER_MINOR >= 4
+        if (setjmp(png_jmpbuf((png_ptr)))) {
+#else
+        if (setjmp(png_ptr->jmpbuf)) {
+#endif
+            return(false);
+        }
+        png_read_row(png_ptr, rgba, NULL);
+    }
+    next_row++;
+    return(true);
+}
+
+bool
+PngReader::ReadImage(PixelBuffer *buffer) {
+    // The passes can run over the destination rows themselves
+    if (passes == 1 || next_row > 0)
+        return(ImageReader::ReadImage(buffer));
+
+    if (height == 0)
+        return(true);
+    if (!readPasses(buffer->Row(0), buffer->Stride()))
+        return(false);
+    next_row = height;
+    return(true);
+}
@@ -0,0 +1,59 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   The decoding code has been adapted from xplanet 1.0.1,
+   Copyright (C) 2002-04 Hari Nair <hari@alumni.caltech.edu>
+*/
+
+#ifndef _IMAGEREADER_H_
+#define _IMAGEREADER_H_
+
+#include "pixelbuffer.h"
+
+/* Decodes a PNG or JPEG file one row at a time, top to bottom */
+class ImageReader {
+public:
+    /* Returns NULL if the file can't be opened or decoded.
+     * If the image is only needed at min_width x min_height or less,
+     * a JPEG is decoded at the smallest size of 1/8, 1/4 or 1/2 that is
+     * still at least that large. Rows are decoded in the given channel
+     * order by the decoder itself.
+     */
+    static ImageReader *Open(const char *filename, const int min_width = 0,
+                             const int min_height = 0,
+                             const ChannelOrder order = ORDER_RGBA);
+
+    virtual ~ImageReader() {};
+
+    int Width() const {
+        return(width);
+    };
+    int Height() const {
+        return(height);
+    };
+    bool HasAlpha() const {
+        return(has_alpha);
+    };
+
+    /* Decode the next row into rgba (4 * width bytes, in the order
+     * asked for), opaque if the image has no alpha channel.
+     */
+    virtual bool ReadRow(unsigned char *rgba) = 0;
+
+    /* Decode all remaining rows into the rows of pixels, which must be
+     * Width() x Height(); no row is buffered on the way.
+     */
+    virtual bool ReadImage(PixelBuffer *pixels);
+
+protected:
+    ImageReader() : width(0), height(0), has_alpha(false) {};
+
+    int width, height;
+    bool has_alpha;
+};
+
+#endif
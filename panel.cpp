@@ -10,151 +10,328 @@
 */
 
 #include <sstream>
-#include <poll.h>
 #include "panel.h"
+#include "imagecache.h"
+#include "renderer.h"
 
 using namespace std;
 
-Panel::Panel(Display* dpy, int scr, Window root, Cfg* config, const string& themedir)
-    : Dpy(dpy), Scr(scr), Root(root), cfg(config), session(""),
+Panel::Panel(Display* dpy, int scr, Window root, Cfg* config, const string& themedir,
+             ThemeAssets* assets, EventLoop* events)
+    : cfg(config), events(events), MessageTimer(-1),
+      Root(root), Dpy(dpy), Scr(scr),
+      resources(dpy, scr, config->getOption("cache_dir")),
       // Load properties from config / theme
       input_name(cfg->getIntOption("input_name_x"), cfg->getIntOption("input_name_y")),
       input_pass(cfg->getIntOption("input_pass_x"), cfg->getIntOption("input_pass_y")),
-      inputShadowOffset(cfg->getIntOption("input_shadow_xoffset"), cfg->getIntOption("input_shadow_yoffset"))
+      inputShadowOffset(cfg->getIntOption("input_shadow_xoffset"), cfg->getIntOption("input_shadow_yoffset")),
+      session("")
 {
 
-    // Init GC
+    // Fonts and colors, which are often the same for several elements
+    font = resources.Font(cfg->getOption("input_font"));
+    welcomefont = resources.Font(cfg->getOption("welcome_font"));
+    enterfont = resources.Font(cfg->getOption("username_font"));
+    inputcolor = resources.Color(cfg->getOption("input_color"));
+    inputshadowcolor = resources.Color(cfg->getOption("input_shadow_color"));
+    welcomecolor = resources.Color(cfg->getOption("welcome_color"));
+    welcomeshadowcolor =
+        resources.Color(cfg->getOption("welcome_shadow_color"));
+    entercolor = resources.Color(cfg->getOption("username_color"));
+    entershadowcolor =
+        resources.Color(cfg->getOption("username_shadow_color"));
+    resources.Save();
+
+    // Init GC, which only draws the cursor
     XGCValues gcv;
     unsigned long gcm = GCForeground | GCBackground | GCGraphicsExposures;
-    gcv.foreground = GetColor("black");
+    gcv.foreground = inputcolor->pixel;
     gcv.background = GetColor("white");
     gcv.graphics_exposures = False;
     TextGC = XCreateGC(Dpy, Root, gcm, &gcv);
+    Win = None;
+    field = Get_Name;
+    Damage = XCreateRegion();
 
-    font = XftFontOpenName(Dpy, Scr, cfg->getOption("input_font").c_str());
-    welcomefont = XftFontOpenName(Dpy, Scr, cfg->getOption("welcome_font").c_str());
-    introfont = XftFontOpenName(Dpy, Scr, cfg->getOption("intro_font").c_str());
-    enterfont = XftFontOpenName(Dpy, Scr, cfg->getOption("username_font").c_str());
-    msgfont = XftFontOpenName(Dpy, Scr, cfg->getOption("msg_font").c_str());
-
-    Visual* visual = DefaultVisual(Dpy, Scr);
-    Colormap colormap = DefaultColormap(Dpy, Scr);
-    // NOTE: using XftColorAllocValue() would be a better solution. Lazy me.
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("input_color").c_str(), &inputcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("input_shadow_color").c_str(), &inputshadowcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("welcome_color").c_str(), &welcomecolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("welcome_shadow_color").c_str(), &welcomeshadowcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("username_color").c_str(), &entercolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("username_shadow_color").c_str(), &entershadowcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("msg_color").c_str(), &msgcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("msg_shadow_color").c_str(), &msgshadowcolor);
-    XftColorAllocName(Dpy, visual, colormap, cfg->getOption("intro_color").c_str(), &introcolor);
-    XftColorAllocName(Dpy, DefaultVisual(Dpy, Scr), colormap,
-                      cfg->getOption("session_color").c_str(), &sessioncolor);
-    XftColorAllocName(Dpy, DefaultVisual(Dpy, Scr), colormap,
-                      cfg->getOption("session_shadow_color").c_str(), &sessionshadowcolor);
+    XGlyphInfo extents;
+    XftTextExtents8(Dpy, font, reinterpret_cast<const XftChar8*>("Wj"), 2,
+                    &extents);
+    CursorHeight = extents.height;
+    CursorDescent = extents.height - extents.y;
+
+    // Typing then never grows the buffers
+    NameBuffer.reserve(INPUT_MAXLENGTH_NAME);
+    PasswdBuffer.reserve(INPUT_MAXLENGTH_PASSWD);
+    HiddenPasswdBuffer.reserve(INPUT_MAXLENGTH_PASSWD);
 
     if (input_pass.x < 0 || input_pass.y < 0) { // single inputbox mode
         input_pass.x = input_name.x;
         input_pass.y = input_name.y;
     }
 
-    // Load panel and background image
-    string panelpng = "";
-    panelpng = panelpng + themedir +"/panel.png";
-    image = new Image;
-    bool loaded = image->Read(panelpng.c_str());
-    if (!loaded) { // try jpeg if png failed
-        panelpng = themedir + "/panel.jpg";
-        loaded = image->Read(panelpng.c_str());
-        if (!loaded) {
-            logStream << APPNAME
-                 << ": could not load panel image for theme '"
-                 << basename((char*)themedir.c_str()) << "'"
-                 << endl;
-            exit(ERR_EXIT);
+    // Load the panel merged with its background, preferably as it was
+    // prepared last time
+    ImageCache cache(cfg->getOption("cache_dir"), "panel");
+    cache.Add(themedir);
+    cache.AddFile(themedir + "/panel.png");
+    cache.AddFile(themedir + "/panel.jpg");
+    cache.AddFile(themedir + "/background.png");
+    cache.AddFile(themedir + "/background.jpg");
+    cache.AddScreen(Dpy, Scr);
+    cache.Add(cfg->getOption("background_style"));
+    cache.Add(cfg->getOption("background_color"));
+    cache.Add(cfg->getOption("input_panel_x"));
+    cache.Add(cfg->getOption("input_panel_y"));
+
+    PanelPixmap = None;
+    XImageBuffer* buffer = cache.Load(Dpy, Scr);
+    if (buffer == NULL && cfg->getOption("xrender") == "true")
+        PanelPixmap = renderPanel(assets);
+    if (PanelPixmap == None) {
+        if (buffer == NULL) {
+            Image* image = readPanel(assets);
+            buffer = new XImageBuffer(Dpy, Scr, image->Width(),
+                                      image->Height());
+            if (buffer->Valid()) {
+                image->PutRows(buffer);
+                cache.Save(*buffer);
+            }
+            delete image;
         }
+        PanelWidth = buffer->Width();
+        PanelHeight = buffer->Height();
+        PanelPixmap = buffer->CreatePixmap(Root);
+        delete buffer;
     }
 
-    Image* bg = new Image();
+    int screen_width = XWidthOfScreen(ScreenOfDisplay(Dpy, Scr));
+    int screen_height = XHeightOfScreen(ScreenOfDisplay(Dpy, Scr));
+    X = Cfg::absolutepos(cfg->getOption("input_panel_x"), screen_width,
+                         PanelWidth);
+    Y = Cfg::absolutepos(cfg->getOption("input_panel_y"), screen_height,
+                         PanelHeight);
+
+    // Read (and substitute vars in) the welcome message
+    welcome_message = cfg->getWelcomeMessage();
+    intro_message = cfg->getOption("intro_msg");
+    username_message = cfg->getOption("username_msg");
+    password_message = cfg->getOption("password_msg");
+
+    // Lay out the scene
+    initText(Scene[WelcomeText], &welcome_message, welcomefont,
+             welcomecolor, welcomeshadowcolor, "welcome");
+    placeText(Scene[WelcomeText], "welcome");
+    initText(Scene[UsernameText], &username_message, enterfont,
+             entercolor, entershadowcolor, "username");
+    placeText(Scene[UsernameText], "username");
+    initText(Scene[PasswordText], &password_message, enterfont,
+             entercolor, entershadowcolor, "username");
+    placeText(Scene[PasswordText], "password");
+    initText(Scene[NameText], &NameBuffer, font,
+             inputcolor, inputshadowcolor, "input");
+    Scene[NameText].pos = input_name;
+    initText(Scene[PasswdText], &HiddenPasswdBuffer, font,
+             inputcolor, inputshadowcolor, "input");
+    Scene[PasswdText].pos = input_pass;
+
+    BackBuffer = XCreatePixmap(Dpy, Root, PanelWidth, PanelHeight,
+                               DefaultDepth(Dpy, Scr));
+    BackDraw = XftDrawCreate(Dpy, BackBuffer, DefaultVisual(Dpy, Scr),
+                             DefaultColormap(Dpy, Scr));
+}
+
+void Panel::initText(Text& text, const string* str, XftFont* font,
+                     XftColor* color, XftColor* shadowColor,
+                     const char* shadow) {
+    string name(shadow);
+    text.str = str;
+    text.font = font;
+    text.color = color;
+    text.shadowColor = shadowColor;
+    text.shadowOffset.x = cfg->getIntOption(name + "_shadow_xoffset");
+    text.shadowOffset.y = cfg->getIntOption(name + "_shadow_yoffset");
+    text.placed = true;
+    text.visible = false;
+    text.bounds.width = text.bounds.height = 0;
+}
+
+/* Position text on the panel as the name_x and name_y options say; it is
+ * left out if either is negative */
+void Panel::placeText(Text& text, const char* position) {
+    string name(position);
+    XGlyphInfo extents;
+    XftTextExtentsUtf8(Dpy, text.font,
+                       reinterpret_cast<const FcChar8*>(text.str->data()),
+                       text.str->length(), &extents);
+    text.pos.x = Cfg::absolutepos(cfg->getOption(name + "_x"), PanelWidth,
+                                  extents.width);
+    text.pos.y = Cfg::absolutepos(cfg->getOption(name + "_y"), PanelHeight,
+                                  extents.height);
+    text.placed = text.pos.x >= 0 && text.pos.y >= 0;
+    bound(text);
+}
+
+/* Find the area the ink of the string and its shadow covers, with a pixel
+ * to spare for antialiasing */
+void Panel::bound(Text& text) {
+    XGlyphInfo extents;
+    XftTextExtentsUtf8(Dpy, text.font,
+                       reinterpret_cast<const FcChar8*>(text.str->data()),
+                       text.str->length(), &extents);
+    if (extents.width == 0 || extents.height == 0) {
+        text.bounds.width = text.bounds.height = 0;
+        return;
+    }
+
+    int x0 = text.pos.x - extents.x;
+    int y0 = text.pos.y - extents.y;
+    int x1 = x0 + extents.width;
+    int y1 = y0 + extents.height;
+    // The shadow is only drawn with both offsets set
+    if (text.shadowOffset.x && text.shadowOffset.y) {
+        if (text.shadowOffset.x < 0)
+            x0 += text.shadowOffset.x;
+        else
+            x1 += text.shadowOffset.x;
+        if (text.shadowOffset.y < 0)
+            y0 += text.shadowOffset.y;
+        else
+            y1 += text.shadowOffset.y;
+    }
+    text.bounds.x = x0 - 1;
+    text.bounds.y = y0 - 1;
+    text.bounds.width = x1 - x0 + 2;
+    text.bounds.height = y1 - y0 + 2;
+}
+
+/* Put the cursor after the text of the current field */
+void Panel::placeCursor() {
+    const Text& text = Scene[field == Get_Name ? NameText : PasswdText];
+    XGlyphInfo extents;
+    XftTextExtentsUtf8(Dpy, font,
+                       reinterpret_cast<const FcChar8*>(text.str->data()),
+                       text.str->length(), &extents);
+    CursorArea.x = text.pos.x + extents.width + 1;
+    CursorArea.y = text.pos.y - CursorHeight;
+    CursorArea.width = 1;
+    CursorArea.height = CursorHeight + CursorDescent + 1;
+}
+
+/* Exit for lack of an image in the theme */
+static void
+missingImage(ThemeAssets* assets, const string& name) {
+    logStream << APPNAME
+         << ": could not load " << name << " image for theme '"
+         << basename((char*)assets->ThemeDir().c_str()) << "'"
+         << endl;
+    exit(ERR_EXIT);
+}
+
+/* Prepare the panel on the server; None if RENDER is missing */
+Pixmap Panel::renderPanel(ThemeAssets* assets) {
+    Renderer renderer(Dpy, Scr, Root);
+    if (!renderer.Valid())
+        return(None);
+
+    const Image* panel = assets->PanelImage();
+    if (panel == NULL)
+        missingImage(assets, "panel");
+    Image image(panel);
+
+    int screen_width = XWidthOfScreen(ScreenOfDisplay(Dpy, Scr));
+    int screen_height = XHeightOfScreen(ScreenOfDisplay(Dpy, Scr));
+    X = Cfg::absolutepos(cfg->getOption("input_panel_x"), screen_width,
+                         image.Width());
+    Y = Cfg::absolutepos(cfg->getOption("input_panel_y"), screen_height,
+                         image.Height());
+
+    Image* bg = NULL;
     string bgstyle = cfg->getOption("background_style");
     if (bgstyle != "color") {
-        panelpng = themedir +"/background.png";
-        loaded = bg->Read(panelpng.c_str());
-        if (!loaded) { // try jpeg if png failed
-            panelpng = themedir + "/background.jpg";
-            loaded = bg->Read(panelpng.c_str());
-            if (!loaded){
-                logStream << APPNAME
-                     << ": could not load background image for theme '"
-                     << basename((char*)themedir.c_str()) << "'"
-                     << endl;
-                exit(ERR_EXIT);
-            }
-        }
-    }
-    if (bgstyle == "stretch") {
-        bg->Resize(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)));
-    } else if (bgstyle == "tile") {
-        bg->Tile(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)));
-    } else if (bgstyle == "center") {
-        string hexvalue = cfg->getOption("background_color");
-        hexvalue = hexvalue.substr(1,6);
-        bg->Center(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                   XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                   hexvalue.c_str());
-    } else { // plain color or error
-        string hexvalue = cfg->getOption("background_color");
-        hexvalue = hexvalue.substr(1,6);
-        bg->Center(XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                   XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)),
-                   hexvalue.c_str());
+        const Image* background = assets->Background();
+        if (background == NULL)
+            missingImage(assets, "background");
+        bg = new Image(background);
     }
 
+    PanelWidth = image.Width();
+    PanelHeight = image.Height();
+    Pixmap pixmap = renderer.Background(bg, bgstyle,
+                                        cfg->getOption("background_color"),
+                                        X, Y, PanelWidth, PanelHeight);
+    renderer.Over(pixmap, &image);
+
+    delete bg;
+    return(pixmap);
+}
+
+/* The panel image merged with the background behind it, and its
+ * position */
+Image* Panel::readPanel(ThemeAssets* assets) {
+    const Image* panel = assets->PanelImage();
+    if (panel == NULL)
+        missingImage(assets, "panel");
+    Image* image = new Image(panel);
+
+    int screen_width = XWidthOfScreen(ScreenOfDisplay(Dpy, Scr));
+    int screen_height = XHeightOfScreen(ScreenOfDisplay(Dpy, Scr));
     string cfgX = cfg->getOption("input_panel_x");
     string cfgY = cfg->getOption("input_panel_y");
-    X = Cfg::absolutepos(cfgX, XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), image->Width());
-    Y = Cfg::absolutepos(cfgY, XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)), image->Height());
+    X = Cfg::absolutepos(cfgX, screen_width, image->Width());
+    Y = Cfg::absolutepos(cfgY, screen_height, image->Height());
+
+    // The background is the one of the root window, only computed where
+    // the panel covers it
+    Image* bg;
+    string bgstyle = cfg->getOption("background_style");
+    if (bgstyle == "color") {
+        string hexvalue = cfg->getOption("background_color");
+        hexvalue = hexvalue.substr(1,6);
+        bg = new Image();
+        bg->Plain(screen_width, screen_height, hexvalue.c_str());
+    } else {
+        const Image* frame = assets->Frame();
+        if (frame == NULL)
+            missingImage(assets, "background");
+        bg = new Image(frame);
+    }
 
     // Merge image into background
     image->Merge(bg, X, Y);
     delete bg;
-    PanelPixmap = image->createPixmap(Dpy, Scr, Root);
-
-    // Read (and substitute vars in) the welcome message
-    welcome_message = cfg->getWelcomeMessage();
-    intro_message = cfg->getOption("intro_msg");
+    return(image);
 }
 
+/* Only frees memory and sends requests, without waiting for replies,
+ * so it is safe once the display is lost: Xlib then drops the requests */
 Panel::~Panel() {
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &inputcolor);
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &msgcolor);
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &welcomecolor);
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &entercolor);
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &sessioncolor);
-    XftColorFree (Dpy, DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr), &sessionshadowcolor);
+    if (MessageTimer >= 0)
+        events->RemoveTimer(MessageTimer);
+    XDestroyRegion(Damage);
+    XftDrawDestroy(BackDraw);
+    if (BackBuffer != None)
+        XFreePixmap(Dpy, BackBuffer);
     XFreeGC(Dpy, TextGC);
-    XftFontClose(Dpy, font);
-    XftFontClose(Dpy, msgfont);
-    XftFontClose(Dpy, introfont);
-    XftFontClose(Dpy, welcomefont);
-    XftFontClose(Dpy, enterfont);
-    delete image;
+    // None if the panel image couldn't be uploaded
+    if (PanelPixmap != None)
+        XFreePixmap(Dpy, PanelPixmap);
 
 }
 
 void Panel::OpenPanel() {
     // Create window
     Win = XCreateSimpleWindow(Dpy, Root, X, Y,
-                              image->Width(),
-                              image->Height(),
+                              PanelWidth,
+                              PanelHeight,
                               0, GetColor("white"), GetColor("white"));
 
     // Events
     XSelectInput(Dpy, Win, ExposureMask | KeyPressMask);
 
-    // Set background
-    XSetWindowBackgroundPixmap(Dpy, Win, PanelPixmap);
+    // No background: exposed parts are copied from the back buffer,
+    // without being cleared first
+    XSetWindowBackgroundPixmap(Dpy, Win, None);
+    redraw();
 
     // Show window
     XMapWindow(Dpy, Win);
@@ -171,6 +348,7 @@ void Panel::ClosePanel() {
     XUngrabKeyboard(Dpy, CurrentTime);
     XUnmapWindow(Dpy, Win);
     XDestroyWindow(Dpy, Win);
+    Win = None;
     XFlush(Dpy);
 }
 
@@ -178,15 +356,14 @@ void Panel::ClearPanel() {
     session = "";
     Reset();
     XClearWindow(Dpy, Root);
-    XClearWindow(Dpy, Win);
-    Cursor(SHOW);
-    ShowText();
+    redraw();
     XFlush(Dpy);
 }
 
 void Panel::Message(const string& text) {
     string cfgX, cfgY;
     XGlyphInfo extents;
+    XftFont* msgfont = resources.Font(cfg->getOption("msg_font"));
     XftDraw *draw = XftDrawCreate(Dpy, Root,
                                   DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr));
     XftTextExtentsUtf8(Dpy, msgfont, reinterpret_cast<const XftChar8*>(text.c_str()),
@@ -198,20 +375,29 @@ void Panel::Message(const string& text) {
     int msg_x = Cfg::absolutepos(cfgX, XWidthOfScreen(ScreenOfDisplay(Dpy, Scr)), extents.width);
     int msg_y = Cfg::absolutepos(cfgY, XHeightOfScreen(ScreenOfDisplay(Dpy, Scr)), extents.height);
 
-    SlimDrawString8 (draw, &msgcolor, msgfont, msg_x, msg_y,
+    SlimDrawString8 (draw, resources.Color(cfg->getOption("msg_color")),
+                     msgfont, msg_x, msg_y,
                      text,
-                     &msgshadowcolor,
+                     resources.Color(cfg->getOption("msg_shadow_color")),
                      shadowXOffset, shadowYOffset);
     XFlush(Dpy);
     XftDrawDestroy(draw);
 }
 
-void Panel::Error(const string& text) {
-    ClosePanel();
-    Message(text);
-    sleep(ERROR_DURATION);
-    OpenPanel();
+/* Show text for a few seconds, over the panel still taking keys */
+void Panel::Error(const string& text, int seconds) {
     ClearPanel();
+    Message(text);
+    if (MessageTimer >= 0)
+        events->RemoveTimer(MessageTimer);
+    MessageTimer = events->AddTimer(seconds * 1000, messageExpired, this);
+}
+
+void Panel::messageExpired(void* data, int) {
+    Panel* panel = static_cast<Panel*>(data);
+    panel->MessageTimer = -1;
+    XClearWindow(panel->Dpy, panel->Root);
+    XFlush(panel->Dpy);
 }
 
 
@@ -230,118 +416,145 @@ unsigned long Panel::GetColor(const char* colorname) {
     return color.pixel;
 }
 
-void Panel::Cursor(int visible) {
-    const char* text;
-    int xx, yy, y2, cheight;
-    const char* txth = "Wj"; // used to get cursor height
+/* Lay out the fields as they are now and draw the whole panel */
+void Panel::redraw() {
+    bool singleInputMode =
+    input_name.x == input_pass.x &&
+    input_name.y == input_pass.y;
 
-    switch(field) {
-        case Get_Passwd:
-            text = HiddenPasswdBuffer.c_str();
-            xx = input_pass.x;
-            yy = input_pass.y;
-            break;
+    Scene[WelcomeText].visible = Scene[WelcomeText].placed;
+    Scene[UsernameText].visible = Scene[UsernameText].placed
+                                  && (!singleInputMode || field == Get_Name);
+    Scene[PasswordText].visible = Scene[PasswordText].placed
+                                  && (!singleInputMode || field == Get_Passwd);
+    Scene[NameText].visible = !singleInputMode || field == Get_Name;
+    Scene[PasswdText].visible = !singleInputMode || field == Get_Passwd;
+    bound(Scene[NameText]);
+    bound(Scene[PasswdText]);
+    placeCursor();
+
+    XRectangle all = { 0, 0, (unsigned short) PanelWidth,
+                       (unsigned short) PanelHeight };
+    paint(all);
+}
 
-        case Get_Name:
-            text = NameBuffer.c_str();
-            xx = input_name.x;
-            yy = input_name.y;
-            break;
+static bool overlaps(const XRectangle& a, const XRectangle& b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width
+           && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static bool contains(const XRectangle& a, const XRectangle& b) {
+    return b.x >= a.x && b.x + b.width <= a.x + a.width
+           && b.y >= a.y && b.y + b.height <= a.y + a.height;
+}
+
+static XRectangle unite(const XRectangle& a, const XRectangle& b) {
+    if (a.width == 0 || a.height == 0)
+        return b;
+    if (b.width == 0 || b.height == 0)
+        return a;
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    XRectangle r = { (short) x0, (short) y0, (unsigned short) (x1 - x0),
+                     (unsigned short) (y1 - y0) };
+    return r;
+}
+
+/* Draw the scene over area of the back buffer and show it */
+void Panel::paint(const XRectangle& area) {
+    if (area.width == 0 || area.height == 0)
+        return;
+
+    XCopyArea(Dpy, PanelPixmap, BackBuffer, TextGC, area.x, area.y,
+              area.width, area.height, area.x, area.y);
+
+    // A string reaching out of the area is clipped to it, lest its
+    // antialiased edges be drawn twice
+    bool clipped = false;
+    for (int i = 0; i < SceneSize; i++) {
+        const Text& text = Scene[i];
+        if (!text.visible || !overlaps(text.bounds, area))
+            continue;
+        if (!clipped && !contains(area, text.bounds)) {
+            XftDrawSetClipRectangles(BackDraw, 0, 0, &area, 1);
+            clipped = true;
+        }
+        SlimDrawString8(BackDraw, text.color, text.font,
+                        text.pos.x, text.pos.y, *text.str,
+                        text.shadowColor,
+                        text.shadowOffset.x, text.shadowOffset.y);
     }
+    if (clipped)
+        XftDrawSetClip(BackDraw, None);
 
-    XGlyphInfo extents;
-    XftTextExtents8(Dpy, font, (XftChar8*)txth, strlen(txth), &extents);
-    cheight = extents.height;
-    y2 = yy - extents.y + extents.height;
-    XftTextExtents8(Dpy, font, (XftChar8*)text, strlen(text), &extents);
-    xx += extents.width;
-
-    if(visible == SHOW) {
-        XSetForeground(Dpy, TextGC,
-                       GetColor(cfg->getOption("input_color").c_str()));
-        XDrawLine(Dpy, Win, TextGC,
-                  xx+1, yy-cheight,
-                  xx+1, y2);
-    } else {
-        XClearArea(Dpy, Win, xx+1, yy-cheight,
-                   1, y2-(yy-cheight)+1, false);
+    if (overlaps(CursorArea, area)) {
+        XDrawLine(Dpy, BackBuffer, TextGC,
+                  CursorArea.x, CursorArea.y,
+                  CursorArea.x, CursorArea.y + CursorArea.height - 1);
+    }
+
+    if (Win != None) {
+        XCopyArea(Dpy, BackBuffer, Win, TextGC, area.x, area.y,
+                  area.width, area.height, area.x, area.y);
     }
 }
 
 void Panel::EventHandler(const Panel::FieldType& curfield) {
-    XEvent event;
     field=curfield;
-    bool loop = true;
-    OnExpose();
-
-    struct pollfd x11_pfd = {0};
-    x11_pfd.fd = ConnectionNumber(Dpy);
-    x11_pfd.events = POLLIN;
-    while(loop) {
-        if(XPending(Dpy) || poll(&x11_pfd, 1, -1) > 0) {
-            while(XPending(Dpy)) {
-                XNextEvent(Dpy, &event);
-                switch(event.type) {
-                    case Expose:
-                        OnExpose();
-                        break;
-
-                    case KeyPress:
-                        loop=OnKeyPress(event);
-                        break;
-                }
-            }
-        }
-    }
+    finished = false;
+    redraw();
+
+    // Events may be queued already, without the connection being readable
+    events->Watch(ConnectionNumber(Dpy), connectionReadable, this);
+    handleEvents();
+    events->RunUntil(&finished);
+    events->Unwatch(ConnectionNumber(Dpy));
+}
 
-    return;
+void Panel::connectionReadable(void* data, int) {
+    static_cast<Panel*>(data)->handleEvents();
 }
 
-void Panel::OnExpose(void) {
-    XftDraw *draw = XftDrawCreate(Dpy, Win,
-                        DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr));
-    XClearWindow(Dpy, Win);
-    if (input_pass.x != input_name.x || input_pass.y != input_name.y){
-        SlimDrawString8 (draw, &inputcolor, font, input_name.x, input_name.y,
-                         NameBuffer,
-                         &inputshadowcolor,
-                         inputShadowOffset.x, inputShadowOffset.y);
-        SlimDrawString8 (draw, &inputcolor, font, input_pass.x, input_pass.y,
-                         HiddenPasswdBuffer,
-                         &inputshadowcolor,
-                         inputShadowOffset.x, inputShadowOffset.y);
-    } else { //single input mode
-        switch(field) {
-            case Get_Passwd:
-                SlimDrawString8 (draw, &inputcolor, font,
-                                 input_pass.x, input_pass.y,
-                                 HiddenPasswdBuffer,
-                                 &inputshadowcolor,
-                                 inputShadowOffset.x, inputShadowOffset.y);
+/* Handle the queued events up to the end of the field; the keys typed
+ * after it stay queued for the next one */
+void Panel::handleEvents() {
+    XEvent event;
+    while(!finished && XPending(Dpy)) {
+        XNextEvent(Dpy, &event);
+        switch(event.type) {
+            case Expose: {
+                XRectangle area = { (short) event.xexpose.x,
+                                    (short) event.xexpose.y,
+                                    (unsigned short) event.xexpose.width,
+                                    (unsigned short) event.xexpose.height };
+                XUnionRectWithRegion(&area, Damage, Damage);
                 break;
-            case Get_Name:
-                SlimDrawString8 (draw, &inputcolor, font,
-                                 input_name.x, input_name.y,
-                                 NameBuffer,
-                                 &inputshadowcolor,
-                                 inputShadowOffset.x, inputShadowOffset.y);
+            }
+
+            case KeyPress:
+                finished = !OnKeyPress(event);
                 break;
         }
     }
 
-    XftDrawDestroy (draw);
-    Cursor(SHOW);
-    ShowText();
+    // Repair every exposure queued so far in one copy
+    if (!XEmptyRegion(Damage)) {
+        XSetRegion(Dpy, TextGC, Damage);
+        XCopyArea(Dpy, BackBuffer, Win, TextGC, 0, 0,
+                  PanelWidth, PanelHeight, 0, 0);
+        XSetClipMask(Dpy, TextGC, None);
+        XDestroyRegion(Damage);
+        Damage = XCreateRegion();
+    }
+    XFlush(Dpy);
 }
 
 bool Panel::OnKeyPress(XEvent& event) {
     char ascii;
     KeySym keysym;
     XComposeStatus compstatus;
-    int xx;
-    int yy;
-    string text;
-    string formerString = "";
     
     XLookupString(&event.xkey, &ascii, 1, &keysym, &compstatus);
     switch(keysym){
@@ -351,7 +564,7 @@ bool Panel::OnKeyPress(XEvent& event) {
 
         case XK_F11:
             // Take a screenshot
-            system(cfg->getOption("screenshot_cmd").c_str());
+            events->System(cfg->getOption("screenshot_cmd").c_str());
             return true;
 
         case XK_Return:
@@ -379,20 +592,20 @@ bool Panel::OnKeyPress(XEvent& event) {
             break;
     };
 
-    Cursor(HIDE);
+    Text& text = Scene[field == Get_Name ? NameText : PasswdText];
+    const string::size_type formerLength = text.str->length();
+
     switch(keysym){
         case XK_Delete:
         case XK_BackSpace:
             switch(field) {
                 case GET_NAME:
                     if (! NameBuffer.empty()){
-                        formerString=NameBuffer;
                         NameBuffer.erase(--NameBuffer.end());
                     };
                     break;
                 case GET_PASSWD:
                     if (! PasswdBuffer.empty()){
-                        formerString=HiddenPasswdBuffer;
                         PasswdBuffer.erase(--PasswdBuffer.end());
                         HiddenPasswdBuffer.erase(--HiddenPasswdBuffer.end());
                     };
@@ -405,13 +618,11 @@ bool Panel::OnKeyPress(XEvent& event) {
             if (reinterpret_cast<XKeyEvent&>(event).state & ControlMask) {
                 switch(field) {
                     case Get_Passwd:
-                        formerString = HiddenPasswdBuffer;
                         HiddenPasswdBuffer.clear();
                         PasswdBuffer.clear();
                         break;
 
                     case Get_Name:
-                        formerString = NameBuffer;
                         NameBuffer.clear();
                         break;
                 };
@@ -423,16 +634,14 @@ bool Panel::OnKeyPress(XEvent& event) {
             if (isprint(ascii) && (keysym < XK_Shift_L || keysym > XK_Hyper_R)){
                 switch(field) {
                     case GET_NAME:
-                        formerString=NameBuffer;
                         if (NameBuffer.length() < INPUT_MAXLENGTH_NAME-1){
-                            NameBuffer.append(&ascii,1);
+                            NameBuffer.push_back(ascii);
                         };
                         break;
                     case GET_PASSWD:
-                        formerString=HiddenPasswdBuffer;
                         if (PasswdBuffer.length() < INPUT_MAXLENGTH_PASSWD-1){
-                            PasswdBuffer.append(&ascii,1);
-                            HiddenPasswdBuffer.append("*");
+                            PasswdBuffer.push_back(ascii);
+                            HiddenPasswdBuffer.push_back('*');
                         };
                     break;
                 };
@@ -440,112 +649,17 @@ bool Panel::OnKeyPress(XEvent& event) {
             break;
     };
 
-    XGlyphInfo extents;
-    XftDraw *draw = XftDrawCreate(Dpy, Win,
-                                  DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr));
-
-   switch(field) {
-        case Get_Name:
-            text = NameBuffer;
-            xx = input_name.x;
-            yy = input_name.y;
-            break;
-
-        case Get_Passwd:
-            text = HiddenPasswdBuffer;
-            xx = input_pass.x;
-            yy = input_pass.y;
-            break;
-    }
-
-    if (!formerString.empty()){
-        const char* txth = "Wj"; // get proper maximum height ?
-        XftTextExtents8(Dpy, font, reinterpret_cast<const XftChar8*>(txth), strlen(txth), &extents);
-        int maxHeight = extents.height;
-
-        XftTextExtents8(Dpy, font, reinterpret_cast<const XftChar8*>(formerString.c_str()),
-                        formerString.length(), &extents);
-        int maxLength = extents.width;
-
-        XClearArea(Dpy, Win, xx-3, yy-maxHeight-3,
-                   maxLength+6, maxHeight+6, false);
-    }
-
-    if (!text.empty()) {
-        SlimDrawString8 (draw, &inputcolor, font, xx, yy,
-                         text,
-                         &inputshadowcolor,
-                         inputShadowOffset.x, inputShadowOffset.y);
+    // Repaint where the text and the cursor were and are now
+    if (text.str->length() != formerLength) {
+        XRectangle damage = unite(text.bounds, CursorArea);
+        bound(text);
+        placeCursor();
+        damage = unite(damage, unite(text.bounds, CursorArea));
+        paint(damage);
     }
-
-    XftDrawDestroy (draw);
-    Cursor(SHOW);
     return true;
 }
 
-// Draw welcome and "enter username" message
-void Panel::ShowText(){
-    string cfgX, cfgY;
-    XGlyphInfo extents;
-
-    bool singleInputMode =
-    input_name.x == input_pass.x &&
-    input_name.y == input_pass.y;
-
-    XftDraw *draw = XftDrawCreate(Dpy, Win,
-                                  DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr));
-    /* welcome message */
-    XftTextExtents8(Dpy, welcomefont, (XftChar8*)welcome_message.c_str(),
-                    strlen(welcome_message.c_str()), &extents);
-    cfgX = cfg->getOption("welcome_x");
-    cfgY = cfg->getOption("welcome_y");
-    int shadowXOffset = cfg->getIntOption("welcome_shadow_xoffset");
-    int shadowYOffset = cfg->getIntOption("welcome_shadow_yoffset");
-
-    welcome.x = Cfg::absolutepos(cfgX, image->Width(), extents.width);
-    welcome.y = Cfg::absolutepos(cfgY, image->Height(), extents.height);
-    if (welcome.x >= 0 && welcome.y >= 0) {
-        SlimDrawString8 (draw, &welcomecolor, welcomefont,
-                         welcome.x, welcome.y,
-                         welcome_message,
-                         &welcomeshadowcolor, shadowXOffset, shadowYOffset);
-    }
-
-    /* Enter username-password message */
-    string msg;
-    if (!singleInputMode|| field == Get_Passwd ) {
-        msg = cfg->getOption("password_msg");
-        XftTextExtents8(Dpy, enterfont, (XftChar8*)msg.c_str(),
-                        strlen(msg.c_str()), &extents);
-        cfgX = cfg->getOption("password_x");
-        cfgY = cfg->getOption("password_y");
-        int shadowXOffset = cfg->getIntOption("username_shadow_xoffset");
-        int shadowYOffset = cfg->getIntOption("username_shadow_yoffset");
-        password.x = Cfg::absolutepos(cfgX, image->Width(), extents.width);
-        password.y = Cfg::absolutepos(cfgY, image->Height(), extents.height);
-        if (password.x >= 0 && password.y >= 0){
-            SlimDrawString8 (draw, &entercolor, enterfont, password.x, password.y,
-                             msg, &entershadowcolor, shadowXOffset, shadowYOffset);
-        }
-    }
-    if (!singleInputMode|| field == Get_Name ) {
-        msg = cfg->getOption("username_msg");
-        XftTextExtents8(Dpy, enterfont, (XftChar8*)msg.c_str(),
-                        strlen(msg.c_str()), &extents);
-        cfgX = cfg->getOption("username_x");
-        cfgY = cfg->getOption("username_y");
-        int shadowXOffset = cfg->getIntOption("username_shadow_xoffset");
-        int shadowYOffset = cfg->getIntOption("username_shadow_yoffset");
-        username.x = Cfg::absolutepos(cfgX, image->Width(), extents.width);
-        username.y = Cfg::absolutepos(cfgY, image->Height(), extents.height);
-        if (username.x >= 0 && username.y >= 0){
-            SlimDrawString8 (draw, &entercolor, enterfont, username.x, username.y,
-                             msg, &entershadowcolor, shadowXOffset, shadowYOffset);
-        }
-    }
-    XftDrawDestroy(draw);
-}
-
 string Panel::getSession() {
     return session;
 }
@@ -565,7 +679,7 @@ void Panel::ShowSession() {
     string currsession = cfg->getOption("session_msg") + " " + session;
     XGlyphInfo extents;
 	
-	sessionfont = XftFontOpenName(Dpy, Scr, cfg->getOption("session_font").c_str());
+	XftFont* sessionfont = resources.Font(cfg->getOption("session_font"));
     
 	XftDraw *draw = XftDrawCreate(Dpy, Root,
                                   DefaultVisual(Dpy, Scr), DefaultColormap(Dpy, Scr));
@@ -578,9 +692,10 @@ void Panel::ShowSession() {
     int shadowXOffset = cfg->getIntOption("session_shadow_xoffset");
     int shadowYOffset = cfg->getIntOption("session_shadow_yoffset");
 
-    SlimDrawString8(draw, &sessioncolor, sessionfont, x, y,
+    SlimDrawString8(draw, resources.Color(cfg->getOption("session_color")),
+                    sessionfont, x, y,
                     currsession, 
-                    &sessionshadowcolor,
+                    resources.Color(cfg->getOption("session_shadow_color")),
                     shadowXOffset, shadowYOffset);
     XFlush(Dpy);
     XftDrawDestroy(draw);
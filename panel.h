@@ -30,7 +30,10 @@
 #include "switchuser.h"
 #include "log.h"
 #include "image.h"
+#include "themeassets.h"
 #include "coord.h"
+#include "resources.h"
+#include "eventloop.h"
 
 class Panel {
 public:
@@ -49,13 +52,14 @@ public:
 
 
     Panel(Display* dpy, int scr, Window root, Cfg* config,
-          const std::string& themed);
+          const std::string& themed, ThemeAssets* assets,
+          EventLoop* events);
     ~Panel();
     void OpenPanel();
     void ClosePanel();
     void ClearPanel();
     void Message(const std::string& text);
-    void Error(const std::string& text);
+    void Error(const std::string& text, int seconds = ERROR_DURATION);
     void EventHandler(const FieldType& curfield);
     std::string getSession();
     ActionType getAction(void) const;
@@ -68,11 +72,13 @@ public:
     const std::string& GetPasswd(void) const;
 private:
     Panel();
-    void Cursor(int visible);
+    Image* readPanel(ThemeAssets* assets);
+    Pixmap renderPanel(ThemeAssets* assets);
     unsigned long GetColor(const char* colorname);
-    void OnExpose(void);
     bool OnKeyPress(XEvent& event);
-    void ShowText();
+    void handleEvents();
+    static void connectionReadable(void* data, int fd);
+    static void messageExpired(void* data, int timer);
     void SwitchSession();
     void ShowSession();
 
@@ -81,7 +87,42 @@ private:
                             XftColor* shadowColor,
                             int xOffset, int yOffset);
 
+    /* A string of the panel, with its shadow */
+    struct Text {
+        const std::string* str;
+        XftFont* font;
+        XftColor* color;
+        XftColor* shadowColor;
+        Coord shadowOffset;
+        Coord pos;
+        // Drawn at all, and in the current field
+        bool placed;
+        bool visible;
+        // What the string and its shadow cover
+        XRectangle bounds;
+    };
+    enum {
+        WelcomeText,
+        UsernameText,
+        PasswordText,
+        NameText,
+        PasswdText,
+        SceneSize
+    };
+
+    void initText(Text& text, const std::string* str, XftFont* font,
+                  XftColor* color, XftColor* shadowColor,
+                  const char* shadow);
+    void placeText(Text& text, const char* position);
+    void bound(Text& text);
+    void placeCursor();
+    void redraw();
+    void paint(const XRectangle& area);
+
     Cfg* cfg;
+    EventLoop* events;
+    // Clears the message shown by Error
+    int MessageTimer;
 
     // Private data
     Window Win;
@@ -91,48 +132,55 @@ private:
     int X, Y;
     GC TextGC;
     XftFont* font;
-    XftColor inputshadowcolor;
-    XftColor inputcolor;
-    XftColor msgcolor;
-    XftColor msgshadowcolor;
-    XftFont* msgfont;
-    XftColor introcolor;
-    XftFont* introfont;
+    // Of "Wj" in font, the extent of the cursor around the baseline
+    int CursorHeight;
+    int CursorDescent;
+    XftColor* inputshadowcolor;
+    XftColor* inputcolor;
     XftFont* welcomefont;
-    XftColor welcomecolor;
-    XftFont* sessionfont;
-    XftColor sessioncolor;
-    XftColor sessionshadowcolor;
-    XftColor welcomeshadowcolor;
+    XftColor* welcomecolor;
+    XftColor* welcomeshadowcolor;
     XftFont* enterfont;
-    XftColor entercolor;
-    XftColor entershadowcolor;
+    XftColor* entercolor;
+    XftColor* entershadowcolor;
+    Resources resources;
     ActionType action;
     FieldType field;
+    // Set once the field is entered
+    bool finished;
+    // The exposed parts of the window not repaired yet
+    Region Damage;
     
     // Username/Password
     std::string NameBuffer;
     std::string PasswdBuffer;
     std::string HiddenPasswdBuffer;
 
+    // The panel as shown: the strings on it and the cursor, laid out
+    // once and drawn on the back buffer, which repairs exposed parts of
+    // the window
+    Text Scene[SceneSize];
+    XRectangle CursorArea;
+    std::string username_message;
+    std::string password_message;
+    Pixmap BackBuffer;
+    XftDraw* BackDraw;
+
     // Configuration
     Coord input_name;
     Coord input_pass;
     Coord inputShadowOffset;
-    Coord welcome;
     Coord welcome_shadow_offset;
     Coord session_shadow_offset;
     Coord intro;
-    Coord username;
     Coord username_shadow_offset;
-    Coord password;
     std::string welcome_message;
     std::string intro_message;
 
     // Pixmap data
     Pixmap PanelPixmap;
-
-    Image* image;
+    int PanelWidth;
+    int PanelHeight;
 
     // For thesting themes
     bool testing;
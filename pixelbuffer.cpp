@@ -0,0 +1,74 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdlib>
+
+#include "pixelbuffer.h"
+
+PixelBuffer::PixelBuffer()
+    : memory(NULL), data(NULL), width(0), height(0), stride(0)
+{
+}
+
+PixelBuffer::PixelBuffer(const int w, const int h)
+    : memory(NULL), data(NULL), width(0), height(0), stride(0)
+{
+    if (w <= 0 || h <= 0)
+        return;
+
+    const int row = (4 * w + ALIGN - 1) & ~(ALIGN - 1);
+    void *p;
+    if (posix_memalign(&p, ALIGN, (size_t) row * h) != 0)
+        return;
+
+    memory = data = (unsigned char *) p;
+    width = w;
+    height = h;
+    stride = row;
+}
+
+PixelBuffer::PixelBuffer(PixelBuffer&& other)
+    : memory(NULL), data(NULL), width(0), height(0), stride(0)
+{
+    Swap(other);
+}
+
+PixelBuffer&
+PixelBuffer::operator=(PixelBuffer&& other) {
+    PixelBuffer old;
+    old.Swap(*this);
+    Swap(other);
+    return(*this);
+}
+
+PixelBuffer::~PixelBuffer() {
+    free(memory);
+}
+
+void
+PixelBuffer::Crop(const int x, const int y, const int w, const int h) {
+    data += y * stride + 4 * x;
+    width = w;
+    height = h;
+}
+
+void
+PixelBuffer::Swap(PixelBuffer& other) {
+    unsigned char *m = memory, *d = data;
+    int w = width, h = height, s = stride;
+    memory = other.memory;
+    data = other.data;
+    width = other.width;
+    height = other.height;
+    stride = other.stride;
+    other.memory = m;
+    other.data = d;
+    other.width = w;
+    other.height = h;
+    other.stride = s;
+}
@@ -0,0 +1,71 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _PIXELBUFFER_H_
+#define _PIXELBUFFER_H_
+
+#include <cstddef>
+
+/* Byte order of the color channels of a pixel; alpha is always the
+ * fourth byte.
+ */
+enum ChannelOrder {
+    ORDER_RGBA,
+    ORDER_BGRA
+};
+
+/* Pixels as interleaved 4 byte RGBA or BGRA, each row stride bytes after
+ * the previous one. Rows of a new buffer start on an ALIGN byte
+ * boundary. The buffer owns its memory; it can be moved but not copied.
+ */
+class PixelBuffer {
+public:
+    static const int ALIGN = 32;
+
+    PixelBuffer();
+    /* Contents are undefined; Empty() if allocation failed */
+    PixelBuffer(const int w, const int h);
+    PixelBuffer(PixelBuffer&& other);
+    PixelBuffer& operator=(PixelBuffer&& other);
+    ~PixelBuffer();
+
+    bool Empty() const {
+        return(data == NULL);
+    };
+    int Width() const {
+        return(width);
+    };
+    int Height() const {
+        return(height);
+    };
+    int Stride() const {
+        return(stride);
+    };
+    unsigned char *Row(const int y) {
+        return(data + y * stride);
+    };
+    const unsigned char *Row(const int y) const {
+        return(data + y * stride);
+    };
+
+    /* Narrow the buffer to a rectangle of it, without copying */
+    void Crop(const int x, const int y, const int w, const int h);
+
+    void Swap(PixelBuffer& other);
+
+private:
+    PixelBuffer(const PixelBuffer&);
+    PixelBuffer& operator=(const PixelBuffer&);
+
+    unsigned char *memory;
+    unsigned char *data;
+    int width, height;
+    int stride;
+};
+
+#endif
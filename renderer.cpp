@@ -0,0 +1,172 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdlib>
+#include <stdint.h>
+
+#include "renderer.h"
+
+Renderer::Renderer(Display* display, int screen, Window root_window)
+    : dpy(display), scr(screen), root(root_window),
+      argb_format(NULL), screen_format(NULL)
+{
+    int event_base, error_base, major, minor;
+    if (!XRenderQueryExtension(dpy, &event_base, &error_base)
+        || !XRenderQueryVersion(dpy, &major, &minor))
+    {
+        return;
+    }
+    // Filters came with 0.6, RepeatPad with 0.10
+    if (major == 0 && minor < 10)
+        return;
+
+    argb_format = XRenderFindStandardFormat(dpy, PictStandardARGB32);
+    screen_format = XRenderFindVisualFormat(dpy, DefaultVisual(dpy, scr));
+}
+
+/* A picture of image in a new 32 bit pixmap, premultiplied if alpha
+ * is used and opaque otherwise.
+ */
+Picture
+Renderer::upload(Image *image, const bool alpha) {
+    const int w = image->Width();
+    const int h = image->Height();
+    const PixelBuffer& pixels = image->Pixels();
+    const bool premultiply = alpha && image->HasAlpha();
+    // Byte offsets of red and blue in a pixel
+    const int red = (image->Order() == ORDER_BGRA) ? 2 : 0;
+    const int blue = 2 - red;
+
+    uint32_t *data = (uint32_t *) malloc(4 * w * h);
+    if (data == NULL)
+        return(None);
+
+    XImage *ximage = XCreateImage(dpy, NULL, 32, ZPixmap, 0, (char *) data,
+                                  w, h, 32, 4 * w);
+    if (ximage == NULL) {
+        free(data);
+        return(None);
+    }
+
+    const uint32_t one = 1;
+    const int host_order = *(const unsigned char *) &one == 1
+                           ? LSBFirst : MSBFirst;
+    const bool swap = (ximage->byte_order != host_order);
+
+    for (int j = 0; j < h; j++) {
+        const unsigned char *rgba = pixels.Row(j);
+        uint32_t *out = data + j * w;
+        for (int i = 0; i < w; i++, rgba += 4) {
+            uint32_t pixel;
+            if (!premultiply) {
+                pixel = 0xff000000 | (rgba[red] << 16) | (rgba[1] << 8)
+                        | rgba[blue];
+            } else {
+                const unsigned int k = rgba[3];
+                pixel = (k << 24) | ((rgba[red] * k + 127) / 255 << 16)
+                        | ((rgba[1] * k + 127) / 255 << 8)
+                        | ((rgba[blue] * k + 127) / 255);
+            }
+            if (swap)
+                pixel = (pixel >> 24) | ((pixel >> 8) & 0xff00)
+                        | ((pixel << 8) & 0xff0000) | (pixel << 24);
+            out[i] = pixel;
+        }
+    }
+
+    Pixmap pixmap = XCreatePixmap(dpy, root, w, h, 32);
+    GC gc = XCreateGC(dpy, pixmap, 0, NULL);
+    XPutImage(dpy, pixmap, gc, ximage, 0, 0, 0, 0, w, h);
+    XFreeGC(dpy, gc);
+    // Also frees data
+    XDestroyImage(ximage);
+
+    Picture picture = XRenderCreatePicture(dpy, pixmap, argb_format, 0, NULL);
+    // The picture keeps the pixmap alive
+    XFreePixmap(dpy, pixmap);
+    return(picture);
+}
+
+Pixmap
+Renderer::Background(Image *image, const std::string& style,
+                     const std::string& color, const int x, const int y,
+                     const int w, const int h) {
+    const int screen_width = XWidthOfScreen(ScreenOfDisplay(dpy, scr));
+    const int screen_height = XHeightOfScreen(ScreenOfDisplay(dpy, scr));
+
+    Pixmap pixmap = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, scr));
+    Picture dst = XRenderCreatePicture(dpy, pixmap, screen_format, 0, NULL);
+
+    if (image != NULL && style == "stretch") {
+        Picture src = upload(image, false);
+        if (src != None) {
+            // Maps destination to source coordinates
+            XTransform transform = {{
+                { XDoubleToFixed((double) image->Width() / screen_width),
+                  0, 0 },
+                { 0, XDoubleToFixed((double) image->Height() / screen_height),
+                  0 },
+                { 0, 0, XDoubleToFixed(1) }
+            }};
+            XRenderPictureAttributes attributes;
+            attributes.repeat = RepeatPad;
+            XRenderChangePicture(dpy, src, CPRepeat, &attributes);
+            XRenderSetPictureTransform(dpy, src, &transform);
+            XRenderSetPictureFilter(dpy, src, FilterBilinear, NULL, 0);
+            XRenderComposite(dpy, PictOpSrc, src, None, dst,
+                             x, y, 0, 0, 0, 0, w, h);
+            XRenderFreePicture(dpy, src);
+        }
+    } else if (image != NULL && style == "tile") {
+        Picture src = upload(image, false);
+        if (src != None) {
+            XRenderPictureAttributes attributes;
+            attributes.repeat = RepeatNormal;
+            XRenderChangePicture(dpy, src, CPRepeat, &attributes);
+            XRenderComposite(dpy, PictOpSrc, src, None, dst,
+                             x, y, 0, 0, 0, 0, w, h);
+            XRenderFreePicture(dpy, src);
+        }
+    } else {
+        // Centered over the background color
+        XRenderColor fill;
+        if (!XRenderParseColor(dpy, (char *) color.c_str(), &fill)) {
+            fill.red = fill.green = fill.blue = 0;
+        }
+        fill.alpha = 0xffff;
+        XRenderFillRectangle(dpy, PictOpSrc, dst, &fill, 0, 0, w, h);
+
+        if (image != NULL) {
+            Picture src = upload(image, true);
+            if (src != None) {
+                const int cx = (screen_width - image->Width()) / 2 - x;
+                const int cy = (screen_height - image->Height()) / 2 - y;
+                XRenderComposite(dpy, PictOpOver, src, None, dst,
+                                 0, 0, 0, 0, cx, cy,
+                                 image->Width(), image->Height());
+                XRenderFreePicture(dpy, src);
+            }
+        }
+    }
+
+    XRenderFreePicture(dpy, dst);
+    return(pixmap);
+}
+
+void
+Renderer::Over(Pixmap pixmap, Image *image) {
+    Picture src = upload(image, true);
+    if (src == None)
+        return;
+
+    Picture dst = XRenderCreatePicture(dpy, pixmap, screen_format, 0, NULL);
+    XRenderComposite(dpy, PictOpOver, src, None, dst, 0, 0, 0, 0, 0, 0,
+                     image->Width(), image->Height());
+    XRenderFreePicture(dpy, dst);
+    XRenderFreePicture(dpy, src);
+}
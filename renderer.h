@@ -0,0 +1,55 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _RENDERER_H_
+#define _RENDERER_H_
+
+#include <string>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+#include "image.h"
+
+/* Scales and composites images on the server with XRender. Images are
+ * uploaded once at their own size; the server does the scaling and
+ * alpha blending into the target pixmaps.
+ */
+class Renderer {
+public:
+    Renderer(Display* dpy, int scr, Window root);
+
+    /* False if the server lacks RENDER 0.10 or 32 bit pixmaps */
+    bool Valid() const {
+        return(argb_format != NULL && screen_format != NULL);
+    };
+
+    /* A w x h pixmap holding the part at (x, y) of the screen
+     * background made from image as background_style says. image may be
+     * NULL for a plain color.
+     */
+    Pixmap Background(Image *image, const std::string& style,
+                      const std::string& color, const int x, const int y,
+                      const int w, const int h);
+
+    /* Blend image over the top left of dst */
+    void Over(Pixmap dst, Image *image);
+
+private:
+    Renderer();
+    Renderer(const Renderer&);
+    Renderer& operator=(const Renderer&);
+
+    Picture upload(Image *image, const bool alpha);
+
+    Display *dpy;
+    int scr;
+    Window root;
+    XRenderPictFormat *argb_format;
+    XRenderPictFormat *screen_format;
+};
+
+#endif
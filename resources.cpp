@@ -0,0 +1,189 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fontconfig/fontconfig.h>
+
+#include "resources.h"
+#include "log.h"
+
+using namespace std;
+
+/* What fontconfig matches against: its configuration and the cache of
+ * installed fonts fc-cache rewrites when they change. They are looked
+ * at on disk, as loading the configuration is much of what is saved.
+ */
+static const char* FONTCONFIG_FILES[] = {
+    "/etc/fonts/fonts.conf",
+    "/etc/fonts/conf.d",
+    "/etc/fonts/local.conf",
+    "/var/cache/fontconfig",
+    NULL
+};
+
+Resources::Resources(Display* dpy, int scr, const string& cache_dir)
+    : dpy(dpy), scr(scr), dir(cache_dir), cache(cache_dir, "fonts"),
+      changed(false)
+{
+    // Always allocated, so it needs no freeing
+    black.pixel = BlackPixel(dpy, scr);
+    black.color.red = black.color.green = black.color.blue = 0;
+    black.color.alpha = 0xffff;
+
+    cache.Add((int) FcGetVersion());
+    const char* config = getenv("FONTCONFIG_FILE");
+    if (config != NULL)
+        cache.AddFile(config);
+    for (int i = 0; FONTCONFIG_FILES[i] != NULL; i++)
+        cache.AddFile(FONTCONFIG_FILES[i]);
+    // Sizes in points depend on the resolution, which may also be set
+    // by the Xft.dpi resource
+    cache.AddScreen(dpy, scr);
+    cache.Add(DisplayWidthMM(dpy, scr));
+    cache.Add(DisplayHeightMM(dpy, scr));
+    const char* xrm = XResourceManagerString(dpy);
+    cache.Add(xrm != NULL ? xrm : "");
+    path = cache.Path();
+
+    if (path.empty())
+        return;
+    ifstream in(path.c_str());
+    string line;
+    while (getline(in, line)) {
+        string::size_type tab = line.find('\t');
+        if (tab != string::npos)
+            resolved[line.substr(0, tab)] = line.substr(tab + 1);
+    }
+}
+
+Resources::~Resources() {
+    Save();
+
+    map<string, XftFont*>::iterator font;
+    for (font = fonts.begin(); font != fonts.end(); ++font)
+        if (font->second != NULL)
+            XftFontClose(dpy, font->second);
+
+    map<string, XftColor>::iterator color;
+    for (color = colors.begin(); color != colors.end(); ++color)
+        XftColorFree(dpy, DefaultVisual(dpy, scr),
+                     DefaultColormap(dpy, scr), &color->second);
+}
+
+XftFont*
+Resources::Font(const string& name) {
+    map<string, XftFont*>::iterator it = fonts.find(name);
+    if (it != fonts.end())
+        return(it->second);
+
+    XftFont* font = NULL;
+    map<string, string>::iterator pattern = resolved.find(name);
+    if (pattern != resolved.end()) {
+        // XftFontOpenPattern takes the pattern over if it succeeds
+        FcPattern* cached = FcNameParse(
+            reinterpret_cast<const FcChar8*>(pattern->second.c_str()));
+        if (cached != NULL) {
+            font = XftFontOpenPattern(dpy, cached);
+            if (font == NULL)
+                FcPatternDestroy(cached);
+        }
+        // The font file may have gone since
+        if (font == NULL) {
+            resolved.erase(pattern);
+            changed = true;
+        }
+    }
+    if (font == NULL)
+        font = match(name);
+
+    fonts[name] = font;
+    return(font);
+}
+
+/* Open the font through a full fontconfig match, as XftFontOpenName
+ * does, and remember what it resolved to */
+XftFont*
+Resources::match(const string& name) {
+    FcPattern* pattern = XftNameParse(name.c_str());
+    if (pattern == NULL)
+        return(NULL);
+
+    FcResult result;
+    FcPattern* match = XftFontMatch(dpy, scr, pattern, &result);
+    FcPatternDestroy(pattern);
+    if (match == NULL)
+        return(NULL);
+
+    // The large sets Xft works out from the file again are left out
+    FcPattern* saved = FcPatternDuplicate(match);
+    FcPatternDel(saved, FC_CHARSET);
+    FcPatternDel(saved, FC_LANG);
+    FcPatternDel(saved, FC_CAPABILITY);
+    FcChar8* unparsed = FcNameUnparse(saved);
+    FcPatternDestroy(saved);
+
+    XftFont* font = XftFontOpenPattern(dpy, match);
+    if (font == NULL) {
+        FcPatternDestroy(match);
+    } else if (unparsed != NULL
+               && name.find_first_of("\t\n") == string::npos)
+    {
+        resolved[name] = reinterpret_cast<const char*>(unparsed);
+        changed = true;
+    }
+    free(unparsed);
+    return(font);
+}
+
+XftColor*
+Resources::Color(const string& name) {
+    map<string, XftColor>::iterator it = colors.find(name);
+    if (it != colors.end())
+        return(&it->second);
+
+    if (missing.count(name) > 0)
+        return(&black);
+
+    XftColor color;
+    if (!XftColorAllocName(dpy, DefaultVisual(dpy, scr),
+                           DefaultColormap(dpy, scr), name.c_str(), &color))
+    {
+        logStream << APPNAME << ": can't allocate color " << name << endl;
+        missing.insert(name);
+        return(&black);
+    }
+    return(&(colors[name] = color));
+}
+
+void
+Resources::Save() {
+    if (!changed || path.empty())
+        return;
+    changed = false;
+
+    // Write a new file and move it into place, so that a reader never
+    // sees part of it
+    mkdir(dir.c_str(), 0755);
+    string tmp = path + ".tmp";
+    ofstream out(tmp.c_str());
+    map<string, string>::iterator it;
+    for (it = resolved.begin(); it != resolved.end(); ++it)
+        out << it->first << '\t' << it->second << '\n';
+    out.close();
+    if (!out || rename(tmp.c_str(), path.c_str()) < 0) {
+        logStream << APPNAME << ": could not write font cache "
+                  << path << endl;
+        remove(tmp.c_str());
+        return;
+    }
+    cache.Prune();
+}
@@ -0,0 +1,61 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _RESOURCES_H_
+#define _RESOURCES_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+#include "imagecache.h"
+
+/* Xft fonts and colors by name, opened when first asked for and shared
+ * by every user of the same name; they stay open as long as this does.
+ * The font a name resolves to is kept in the cache directory, keyed by
+ * the fontconfig setup, so that later runs open it without a fontconfig
+ * match.
+ */
+class Resources {
+public:
+    /* An empty cache_dir disables the font cache */
+    Resources(Display* dpy, int scr, const std::string& cache_dir);
+    ~Resources();
+
+    /* NULL if the font can't be opened */
+    XftFont* Font(const std::string& name);
+    /* Black if the color can't be allocated */
+    XftColor* Color(const std::string& name);
+
+    /* Write the resolved fonts, if any were matched since reading them */
+    void Save();
+
+private:
+    Resources(const Resources&);
+    Resources& operator=(const Resources&);
+
+    XftFont* match(const std::string& name);
+
+    Display* dpy;
+    int scr;
+    std::map<std::string, XftFont*> fonts;
+    std::map<std::string, XftColor> colors;
+    // Names that couldn't be allocated, drawn in black
+    std::set<std::string> missing;
+    XftColor black;
+
+    // Font names and the patterns they resolved to
+    std::map<std::string, std::string> resolved;
+    std::string dir;
+    ImageCache cache;
+    std::string path;
+    bool changed;
+};
+
+#endif
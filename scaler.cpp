@@ -0,0 +1,301 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdlib>
+#include <cstring>
+
+#include "scaler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCALER_AVX2
+#endif
+
+/* Rounding and shift for the vertical pass: both passes contribute
+ * BITS of fraction.
+ */
+#define VSHIFT (2 * Scaler::BITS)
+#define VROUND (1 << (VSHIFT - 1))
+
+typedef void (*VerticalFunc)(const short *r0, const short *r1,
+                             const int w, unsigned char *out, const int n);
+
+static void
+vertical_c(const short *r0, const short *r1, const int w,
+           unsigned char *out, const int n)
+{
+    const int w0 = Scaler::ONE - w;
+    for (int i = 0; i < n; i++)
+        out[i] = (unsigned char) ((r0[i] * w0 + r1[i] * w + VROUND) >> VSHIFT);
+}
+
+#ifdef __SSE2__
+static void
+vertical_sse2(const short *r0, const short *r1, const int w,
+              unsigned char *out, const int n)
+{
+    // _mm_madd_epi16 over interleaved (r0, r1) pairs yields
+    // r0 * w0 + r1 * w in 32 bit lanes
+    const __m128i weights = _mm_set1_epi32((w << 16) | (Scaler::ONE - w));
+    const __m128i round = _mm_set1_epi32(VROUND);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (r0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (r1 + i));
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights);
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights);
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), VSHIFT);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), VSHIFT);
+        __m128i first = _mm_packs_epi32(lo, hi);
+
+        a = _mm_loadu_si128((const __m128i *) (r0 + i + 8));
+        b = _mm_loadu_si128((const __m128i *) (r1 + i + 8));
+        lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights);
+        hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights);
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), VSHIFT);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), VSHIFT);
+        __m128i second = _mm_packs_epi32(lo, hi);
+
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_packus_epi16(first, second));
+    }
+    vertical_c(r0 + i, r1 + i, w, out + i, n - i);
+}
+#endif
+
+#ifdef SCALER_AVX2
+__attribute__((target("avx2"))) static void
+vertical_avx2(const short *r0, const short *r1, const int w,
+              unsigned char *out, const int n)
+{
+    const __m256i weights = _mm256_set1_epi32((w << 16) | (Scaler::ONE - w));
+    const __m256i round = _mm256_set1_epi32(VROUND);
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (r0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (r1 + i));
+        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights);
+        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights);
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), VSHIFT);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), VSHIFT);
+        __m256i first = _mm256_packs_epi32(lo, hi);
+
+        a = _mm256_loadu_si256((const __m256i *) (r0 + i + 16));
+        b = _mm256_loadu_si256((const __m256i *) (r1 + i + 16));
+        lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights);
+        hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights);
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), VSHIFT);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), VSHIFT);
+        __m256i second = _mm256_packs_epi32(lo, hi);
+
+        // packus works per 128 bit lane, put the quadwords back in order
+        __m256i packed = _mm256_packus_epi16(first, second);
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+#ifdef __SSE2__
+    vertical_sse2(r0 + i, r1 + i, w, out + i, n - i);
+#else
+    vertical_c(r0 + i, r1 + i, w, out + i, n - i);
+#endif
+}
+#endif
+
+static VerticalFunc
+pickVertical()
+{
+#ifdef SCALER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return vertical_avx2;
+#endif
+#ifdef __SSE2__
+    return vertical_sse2;
+#else
+    return vertical_c;
+#endif
+}
+
+static const VerticalFunc vertical = pickVertical();
+
+/* Compute the two source taps and the weight of the second one for
+ * every destination position. Pixel centers are aligned, positions
+ * outside the source are clamped to the edge pixels.
+ */
+static void
+computeTaps(const int src, const int dst, int *tap0, int *tap1,
+            short *weight)
+{
+    const long long step = ((long long) src << 16) / dst;
+    for (int i = 0; i < dst; i++) {
+        long long pos = i * step + step / 2 - 0x8000;
+        if (pos < 0)
+            pos = 0;
+
+        int idx = (int) (pos >> 16);
+        int frac = (int) (pos >> (16 - Scaler::BITS)) & (Scaler::ONE - 1);
+        if (idx >= src - 1) {
+            idx = src - 1;
+            frac = 0;
+        }
+
+        tap0[i] = idx;
+        tap1[i] = frac ? idx + 1 : idx;
+        weight[i] = (short) frac;
+    }
+}
+
+Scaler::Scaler(const int src_w, const int src_h, const int dst_w,
+               const int dst_h, const int ch)
+    : src_width(src_w), src_height(src_h),
+      dst_width(dst_w), dst_height(dst_h), channels(ch)
+{
+    xofs0 = new int[dst_width];
+    xofs1 = new int[dst_width];
+    xweight = new short[dst_width];
+    yrow0 = new int[dst_height];
+    yrow1 = new int[dst_height];
+    yweight = new short[dst_height];
+
+    computeTaps(src_width, dst_width, xofs0, xofs1, xweight);
+    for (int i = 0; i < dst_width; i++) {
+        xofs0[i] *= channels;
+        xofs1[i] *= channels;
+    }
+    computeTaps(src_height, dst_height, yrow0, yrow1, yweight);
+}
+
+Scaler::~Scaler() {
+    delete [] xofs0;
+    delete [] xofs1;
+    delete [] xweight;
+    delete [] yrow0;
+    delete [] yrow1;
+    delete [] yweight;
+}
+
+void
+Scaler::Horizontal(const unsigned char *srow, const int x0, const int x1,
+                   short *out) const
+{
+    const int base = xofs0[x0];
+    int i, k;
+
+    switch (channels) {
+    case 1:
+        for (i = x0; i < x1; i++) {
+            const int w = xweight[i];
+            *out++ = (short) (srow[xofs0[i] - base] * (ONE - w)
+                              + srow[xofs1[i] - base] * w);
+        }
+        break;
+    case 3:
+        for (i = x0; i < x1; i++) {
+            const int w = xweight[i];
+            const unsigned char *p0 = srow + xofs0[i] - base;
+            const unsigned char *p1 = srow + xofs1[i] - base;
+            out[0] = (short) (p0[0] * (ONE - w) + p1[0] * w);
+            out[1] = (short) (p0[1] * (ONE - w) + p1[1] * w);
+            out[2] = (short) (p0[2] * (ONE - w) + p1[2] * w);
+            out += 3;
+        }
+        break;
+    case 4:
+        for (i = x0; i < x1; i++) {
+            const int w = xweight[i];
+            const unsigned char *p0 = srow + xofs0[i] - base;
+            const unsigned char *p1 = srow + xofs1[i] - base;
+            out[0] = (short) (p0[0] * (ONE - w) + p1[0] * w);
+            out[1] = (short) (p0[1] * (ONE - w) + p1[1] * w);
+            out[2] = (short) (p0[2] * (ONE - w) + p1[2] * w);
+            out[3] = (short) (p0[3] * (ONE - w) + p1[3] * w);
+            out += 4;
+        }
+        break;
+    default:
+        for (i = x0; i < x1; i++) {
+            const int w = xweight[i];
+            const unsigned char *p0 = srow + xofs0[i] - base;
+            const unsigned char *p1 = srow + xofs1[i] - base;
+            for (k = 0; k < channels; k++)
+                *out++ = (short) (p0[k] * (ONE - w) + p1[k] * w);
+        }
+        break;
+    }
+}
+
+void
+Scaler::Vertical(const short *h0, const short *h1, const int y,
+                 const int n, unsigned char *out) const
+{
+    vertical(h0, h1, yweight[y], out, n * channels);
+}
+
+void
+Scaler::Scale(const unsigned char *src, const int src_stride,
+              const int src_y0, RowSink *sink, const int x0, const int x1,
+              const int y0, const int y1) const
+{
+    if (x0 >= x1)
+        return;
+
+    const int row_size = (x1 - x0) * channels;
+    src += xofs0[x0];
+
+    // Horizontally scaled source rows; consecutive destination rows
+    // mostly share one or both of them, so keep the last two around
+    short *rows[2];
+    int cached[2] = { -1, -1 };
+    rows[0] = new short[2 * row_size];
+    rows[1] = rows[0] + row_size;
+    unsigned char *out = new unsigned char[row_size];
+
+    for (int y = y0; y < y1; y++) {
+        const int s0 = yrow0[y];
+        const int s1 = yrow1[y];
+        short *h0, *h1;
+
+        if (cached[0] == s0) {
+            h0 = rows[0];
+        } else if (cached[1] == s0) {
+            h0 = rows[1];
+        } else {
+            const int slot = (cached[0] == s1) ? 1 : 0;
+            Horizontal(src + (s0 - src_y0) * src_stride, x0, x1,
+                       rows[slot]);
+            cached[slot] = s0;
+            h0 = rows[slot];
+        }
+
+        if (s1 == s0) {
+            h1 = h0;
+        } else if (cached[0] == s1) {
+            h1 = rows[0];
+        } else if (cached[1] == s1) {
+            h1 = rows[1];
+        } else {
+            const int slot = (h0 == rows[0]) ? 1 : 0;
+            Horizontal(src + (s1 - src_y0) * src_stride, x0, x1,
+                       rows[slot]);
+            cached[slot] = s1;
+            h1 = rows[slot];
+        }
+
+        vertical(h0, h1, yweight[y], out, row_size);
+        sink->PutRow(y, out);
+    }
+
+    delete [] rows[0];
+    delete [] out;
+}
@@ -0,0 +1,103 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _SCALER_H_
+#define _SCALER_H_
+
+#include "pixelbuffer.h"
+
+/* Receives destination rows, possibly from several threads at once */
+class RowSink {
+public:
+    virtual ~RowSink() {};
+    virtual void PutRow(const int y, const unsigned char *row) = 0;
+
+    /* Channel order the rows are wanted in */
+    virtual ChannelOrder Order() const {
+        return(ORDER_RGBA);
+    };
+};
+
+/* Separable bilinear scaler.
+ * The per-column and per-row source positions and weights are computed
+ * once in fixed point; scaling is then a horizontal pass over each
+ * needed source row followed by a vertical pass between two of them.
+ * Any rectangle of the destination can be scaled on its own, touching
+ * only the source pixels under it.
+ */
+class Scaler {
+public:
+    Scaler(const int src_w, const int src_h, const int dst_w,
+           const int dst_h, const int channels);
+    ~Scaler();
+
+    /* Scale columns [x0, x1) of destination rows [y0, y1) and hand
+     * them to sink. src is a window of whole source rows, channels
+     * bytes per pixel and src_stride bytes apart, starting at source
+     * row src_y0.
+     */
+    void Scale(const unsigned char *src, const int src_stride,
+               const int src_y0, RowSink *sink, const int x0, const int x1,
+               const int y0, const int y1) const;
+
+    /* Scale one source row horizontally into the values of destination
+     * columns [x0, x1), for Vertical. srow starts at source column
+     * FirstColumn(x0).
+     */
+    void Horizontal(const unsigned char *srow, const int x0, const int x1,
+                    short *out) const;
+
+    /* n columns of destination row y from the horizontally scaled
+     * FirstRow(y) and LastRow(y).
+     */
+    void Vertical(const short *h0, const short *h1, const int y,
+                  const int n, unsigned char *out) const;
+
+    /* First and last source column needed for destination column x */
+    int FirstColumn(const int x) const {
+        return(xofs0[x] / channels);
+    };
+    int LastColumn(const int x) const {
+        return(xofs1[x] / channels);
+    };
+
+    /* First and last source row needed for destination row y */
+    int FirstRow(const int y) const {
+        return(yrow0[y]);
+    };
+    int LastRow(const int y) const {
+        return(yrow1[y]);
+    };
+
+    /* Weights are 7 bit so that intermediate rows fit in 16 bits */
+    static const int BITS = 7;
+    static const int ONE = 1 << BITS;
+
+private:
+    Scaler();
+    Scaler(const Scaler&);
+    Scaler& operator=(const Scaler&);
+
+
+    int src_width, src_height;
+    int dst_width, dst_height;
+    int channels;
+
+    // Byte offsets of the left/right source pixel and right weight,
+    // per destination column
+    int *xofs0;
+    int *xofs1;
+    short *xweight;
+
+    // Upper/lower source row and lower weight, per destination row
+    int *yrow0;
+    int *yrow1;
+    short *yweight;
+};
+
+#endif
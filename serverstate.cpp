@@ -0,0 +1,165 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <string.h>
+#include <X11/Xatom.h>
+
+#include "serverstate.h"
+
+/* Resources a session left behind may be gone by the time they are
+ * freed */
+static int
+ignoreErrors(Display*, XErrorEvent*) {
+    return(0);
+}
+
+static bool
+sameHost(const XHostAddress& a, const XHostAddress& b) {
+    if (a.family != b.family)
+        return false;
+    if (a.family == FamilyServerInterpreted) {
+        const XServerInterpretedAddress* x =
+            (const XServerInterpretedAddress*) a.address;
+        const XServerInterpretedAddress* y =
+            (const XServerInterpretedAddress*) b.address;
+        return x->typelength == y->typelength
+            && x->valuelength == y->valuelength
+            && memcmp(x->type, y->type, x->typelength) == 0
+            && memcmp(x->value, y->value, x->valuelength) == 0;
+    }
+    return a.length == b.length
+        && memcmp(a.address, b.address, a.length) == 0;
+}
+
+static bool
+findHost(const XHostAddress& host, const XHostAddress* list, int count) {
+    for (int i = 0; i < count; i++) {
+        if (sameHost(host, list[i]))
+            return true;
+    }
+    return false;
+}
+
+ServerState::ServerState(Display* dpy, Window root)
+    : Dpy(dpy), Root(root), keysyms(NULL), modmap(NULL),
+      properties(NULL), num_properties(0), hosts(NULL), num_hosts(0),
+      access_enabled(True)
+{
+    XDisplayKeycodes(Dpy, &min_keycode, &max_keycode);
+    keysyms = XGetKeyboardMapping(Dpy, min_keycode,
+                                  max_keycode - min_keycode + 1,
+                                  &keysyms_per_keycode);
+    modmap = XGetModifierMapping(Dpy);
+
+    XGetScreenSaver(Dpy, &saver_timeout, &saver_interval,
+                    &saver_blanking, &saver_exposures);
+
+    properties = XListProperties(Dpy, Root, &num_properties);
+
+    hosts = XListHosts(Dpy, &num_hosts, &access_enabled);
+}
+
+ServerState::~ServerState() {
+    if (keysyms != NULL)
+        XFree(keysyms);
+    if (modmap != NULL)
+        XFreeModifiermap(modmap);
+    if (properties != NULL)
+        XFree(properties);
+    if (hosts != NULL)
+        XFree(hosts);
+}
+
+/* Wallpaper setters leave the root pixmap behind, retained after they
+ * exit, and name it in a root property; free it with its client.
+ */
+void ServerState::freeRetainedPixmap(const char* name, Pixmap keep) {
+    Atom atom = XInternAtom(Dpy, name, True);
+    if (atom == None)
+        return;
+
+    Atom type;
+    int format;
+    unsigned long items, after;
+    unsigned char* data = NULL;
+    if (XGetWindowProperty(Dpy, Root, atom, 0, 1, False, XA_PIXMAP, &type,
+                           &format, &items, &after, &data) == Success
+        && type == XA_PIXMAP && format == 32 && items == 1)
+    {
+        Pixmap pixmap = *(Pixmap*) data;
+        if (pixmap != None && pixmap != keep)
+            XKillClient(Dpy, pixmap);
+    }
+    if (data != NULL)
+        XFree(data);
+}
+
+bool ServerState::Restore(Pixmap background) {
+    XSync(Dpy, False);
+    XErrorHandler old_handler = XSetErrorHandler(ignoreErrors);
+
+    XUngrabPointer(Dpy, CurrentTime);
+    XUngrabKeyboard(Dpy, CurrentTime);
+    XSetInputFocus(Dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
+
+    if (keysyms != NULL) {
+        XChangeKeyboardMapping(Dpy, min_keycode, keysyms_per_keycode,
+                               keysyms, max_keycode - min_keycode + 1);
+    }
+    // Fails while a modifier is held; there is nothing to do about that
+    if (modmap != NULL)
+        XSetModifierMapping(Dpy, modmap);
+
+    XSetScreenSaver(Dpy, saver_timeout, saver_interval, saver_blanking,
+                    saver_exposures);
+    XResetScreenSaver(Dpy);
+
+    freeRetainedPixmap("_XROOTPMAP_ID", background);
+    freeRetainedPixmap("ESETROOT_PMAP_ID", background);
+    // Resources of clients gone with RetainTemporary
+    XKillClient(Dpy, AllTemporary);
+
+    // Drop the root properties the server didn't start with
+    int count;
+    Atom* current = XListProperties(Dpy, Root, &count);
+    for (int i = 0; i < count; i++) {
+        bool found = false;
+        for (int j = 0; j < num_properties && !found; j++)
+            found = (current[i] == properties[j]);
+        if (!found)
+            XDeleteProperty(Dpy, Root, current[i]);
+    }
+    if (current != NULL)
+        XFree(current);
+
+    // Hosts added by the session, or access control turned off, let
+    // clients in without a cookie; revoking it doesn't reach them
+    bool closed = true;
+    int num_current;
+    Bool enabled;
+    XHostAddress* current_hosts = XListHosts(Dpy, &num_current, &enabled);
+    if (access_enabled && !enabled)
+        closed = false;
+    for (int i = 0; i < num_current; i++) {
+        if (!findHost(current_hosts[i], hosts, num_hosts)) {
+            XRemoveHost(Dpy, &current_hosts[i]);
+            closed = false;
+        }
+    }
+    for (int i = 0; i < num_hosts; i++) {
+        if (!findHost(hosts[i], current_hosts, num_current))
+            XAddHost(Dpy, &hosts[i]);
+    }
+    if (current_hosts != NULL)
+        XFree(current_hosts);
+    XSetAccessControl(Dpy, access_enabled ? EnableAccess : DisableAccess);
+
+    XSync(Dpy, False);
+    XSetErrorHandler(old_handler);
+    return closed;
+}
@@ -0,0 +1,55 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _SERVERSTATE_H_
+#define _SERVERSTATE_H_
+
+#include <X11/Xlib.h>
+
+/* Settings of a fresh X server that a session may change: the keyboard
+ * and modifier mappings, the screen saver, the properties of the root
+ * window and the host access list. Taken when the server is new, and put back after a
+ * session so that the server can be used for the next one.
+ */
+class ServerState {
+public:
+    ServerState(Display* dpy, Window root);
+    ~ServerState();
+
+    /* Undo what a session changed; its clients must be gone. False if
+     * the session let clients in by host, which may still be connected
+     */
+    bool Restore(Pixmap background);
+
+private:
+    ServerState();
+    ServerState(const ServerState&);
+    ServerState& operator=(const ServerState&);
+
+    void freeRetainedPixmap(const char* name, Pixmap keep);
+
+    Display* Dpy;
+    Window Root;
+
+    int min_keycode, max_keycode;
+    int keysyms_per_keycode;
+    KeySym* keysyms;
+    XModifierKeymap* modmap;
+
+    int saver_timeout, saver_interval;
+    int saver_blanking, saver_exposures;
+
+    Atom* properties;
+    int num_properties;
+
+    XHostAddress* hosts;
+    int num_hosts;
+    Bool access_enabled;
+};
+
+#endif
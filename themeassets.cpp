@@ -0,0 +1,182 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <cstdio>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "themeassets.h"
+#include "ximagebuffer.h"
+
+using namespace std;
+
+ThemeAssets::ThemeAssets(Cfg* cfg, const string& themed)
+    : themedir(themed), files(stamp(themed)), screen_width(0),
+      screen_height(0),
+      order(ORDER_RGBA), background(NULL), frame(NULL), panel(NULL),
+      background_read(false), panel_read(false), background_width(0),
+      background_height(0), loading(false)
+{
+    bgstyle = cfg->getOption("background_style");
+    bgcolor = cfg->getOption("background_color");
+    xrender = cfg->getOption("xrender");
+}
+
+/* Theme images the store may read */
+static const char* IMAGE_FILES[] = {
+    "background.png",
+    "background.jpg",
+    "panel.png",
+    "panel.jpg",
+    NULL
+};
+
+string ThemeAssets::stamp(const string& themedir) {
+    string files;
+    for (int i = 0; IMAGE_FILES[i] != NULL; i++) {
+        struct stat st;
+        char buf[64] = "-";
+        string path = themedir + "/" + IMAGE_FILES[i];
+        if (stat(path.c_str(), &st) == 0)
+            snprintf(buf, sizeof(buf), "%lld %lld",
+                     (long long) st.st_size, (long long) st.st_mtime);
+        files += buf;
+        files += '\n';
+    }
+    return(files);
+}
+
+bool ThemeAssets::Matches(Cfg* cfg, const string& themed) const {
+    return(themed == themedir
+           && cfg->getOption("background_style") == bgstyle
+           && cfg->getOption("background_color") == bgcolor
+           && cfg->getOption("xrender") == xrender
+           && stamp(themed) == files);
+}
+
+ThemeAssets::~ThemeAssets() {
+    if (loading)
+        pthread_join(loader, NULL);
+    // The frame shows the background
+    delete frame;
+    delete background;
+    delete panel;
+}
+
+void *ThemeAssets::preload(void *arg) {
+    ThemeAssets* assets = static_cast<ThemeAssets*>(arg);
+    // Only decode; the frame is computed row by row as it is uploaded,
+    // rather than held in full next to the upload buffer
+    assets->PanelImage();
+    assets->Background();
+    return(NULL);
+}
+
+void ThemeAssets::Preload(const int w, const int h,
+                          const ChannelOrder pixel_order) {
+    if (loading)
+        return;
+
+    resize(w, h);
+    order = pixel_order;
+    // Signals are for the main thread, which may be waiting for them
+    // through a signalfd; the pool workers the loader starts inherit
+    // the mask too
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    loading = (pthread_create(&loader, NULL, preload, this) == 0);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+void ThemeAssets::Attach(Display* dpy, int scr) {
+    if (loading) {
+        pthread_join(loader, NULL);
+        loading = false;
+    }
+
+    order = XImageBuffer::NativeOrder(dpy, scr);
+    resize(XWidthOfScreen(ScreenOfDisplay(dpy, scr)),
+           XHeightOfScreen(ScreenOfDisplay(dpy, scr)));
+}
+
+/* Lay the background out again for a w x h screen, and decode it again
+ * if it may have been decoded too small */
+void ThemeAssets::resize(const int w, const int h) {
+    if (w == screen_width && h == screen_height)
+        return;
+
+    screen_width = w;
+    screen_height = h;
+    delete frame;
+    frame = NULL;
+    if (background != NULL && bgstyle == "stretch"
+        && (background->Width() < w || background->Height() < h)
+        && (background_width < w || background_height < h))
+    {
+        delete background;
+        background = NULL;
+        background_read = false;
+    }
+}
+
+/* Load themedir/name.png or .jpg; NULL if neither can be read */
+Image* ThemeAssets::read(const string& name, const int min_w,
+                         const int min_h) {
+    Image* image = new Image;
+    string filename = themedir + "/" + name + ".png";
+    bool loaded = image->Read(filename.c_str(), min_w, min_h, order);
+    if (!loaded) { // try jpeg if png failed
+        filename = themedir + "/" + name + ".jpg";
+        loaded = image->Read(filename.c_str(), min_w, min_h, order);
+    }
+    if (!loaded) {
+        delete image;
+        return(NULL);
+    }
+    return(image);
+}
+
+const Image* ThemeAssets::Background() {
+    if (!background_read) {
+        background_read = true;
+        // A stretched JPEG needn't be decoded much larger than the screen
+        if (bgstyle == "stretch") {
+            background = read("background", screen_width, screen_height);
+            background_width = screen_width;
+            background_height = screen_height;
+        } else {
+            background = read("background", 0, 0);
+        }
+    }
+    return(background);
+}
+
+const Image* ThemeAssets::Frame() {
+    if (frame != NULL || Background() == NULL)
+        return(frame);
+
+    frame = new Image(background);
+    if (bgstyle == "stretch") {
+        frame->Resize(screen_width, screen_height);
+    } else if (bgstyle == "tile") {
+        frame->Tile(screen_width, screen_height);
+    } else { // center, plain color or error
+        string hexvalue = bgcolor.substr(1,6);
+        frame->Center(screen_width, screen_height, hexvalue.c_str());
+    }
+    return(frame);
+}
+
+const Image* ThemeAssets::PanelImage() {
+    if (!panel_read) {
+        panel_read = true;
+        panel = read("panel", 0, 0);
+    }
+    return(panel);
+}
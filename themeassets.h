@@ -0,0 +1,92 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _THEMEASSETS_H_
+#define _THEMEASSETS_H_
+
+#include <string>
+#include <pthread.h>
+#include <X11/Xlib.h>
+#include "cfg.h"
+#include "image.h"
+
+/* The images of a theme, each decoded at most once and shared by the
+ * root window and the panel. They may be decoded on a thread of their
+ * own while the X server starts, for a guessed screen;
+ * Attach() checks the guess once the display is open. The images
+ * handed out are read-only and live as long as the store; show them
+ * through Image(const Image*).
+ */
+class ThemeAssets {
+public:
+    ThemeAssets(Cfg* config, const std::string& themedir);
+    ~ThemeAssets();
+
+    /* Start decoding the images for a w x h screen taking pixels in
+     * order, before the display is open */
+    void Preload(const int w, const int h, const ChannelOrder order);
+
+    /* Wait for Preload and redo what doesn't fit the screen; must be
+     * called for every new display before any image is used */
+    void Attach(Display* dpy, int scr);
+
+    const std::string& ThemeDir() const {
+        return(themedir);
+    };
+
+    /* Whether the store still holds what config and themedir give,
+     * including the image files as they are on disk now */
+    bool Matches(Cfg* config, const std::string& themedir) const;
+
+    /* background.png or .jpg, a JPEG decoded no larger than a
+     * stretched background needs; NULL if there is none.
+     */
+    const Image* Background();
+
+    /* The background at screen size as background_style says;
+     * NULL if there is no background image.
+     */
+    const Image* Frame();
+
+    /* panel.png or .jpg; NULL if there is none */
+    const Image* PanelImage();
+
+private:
+    ThemeAssets();
+    ThemeAssets(const ThemeAssets&);
+    ThemeAssets& operator=(const ThemeAssets&);
+
+    Image* read(const std::string& name, const int min_w, const int min_h);
+    void resize(const int w, const int h);
+    static void *preload(void *arg);
+    static std::string stamp(const std::string& themedir);
+
+    std::string themedir;
+    // Sizes and modification times of the image files
+    std::string files;
+    // Options are copied, as Cfg can't be read from the loader thread
+    std::string bgstyle;
+    std::string bgcolor;
+    std::string xrender;
+    int screen_width, screen_height;
+    ChannelOrder order;
+
+    Image* background;
+    Image* frame;
+    Image* panel;
+    // Missing files are only looked for once
+    bool background_read;
+    bool panel_read;
+    // Screen size the background was decoded for
+    int background_width, background_height;
+
+    pthread_t loader;
+    bool loading;
+};
+
+#endif
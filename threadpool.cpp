@@ -0,0 +1,164 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "cfg.h"
+#include "log.h"
+
+/* Upper bound for the automatic default and the configured value */
+#define MAX_THREADS 64
+
+/* Below this many pixels an operation is not worth distributing */
+#define MIN_PIXELS (64 * 1024)
+
+/* Bands handed out per thread, so that uneven bands balance out */
+#define BANDS_PER_THREAD 4
+
+namespace {
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+    int threads = 1;
+    int workers = 0;
+
+    // Current job, protected by lock
+    bool busy = false;
+    ThreadPool::RowFunc job_func = 0;
+    void *job_data = 0;
+    int job_rows = 0;
+    int job_band = 0;
+    int job_bands = 0;
+    int next_band = 0;
+    int done_bands = 0;
+}
+
+void ThreadPool::SetThreads(const std::string& option) {
+    int n = 0;
+
+    if (option != "" && option != "auto") {
+        bool ok = false;
+        n = Cfg::string2int(option.c_str(), &ok);
+        if (!ok || n < 1) {
+            logStream << APPNAME << ": invalid threads value '" << option
+                      << "', using auto" << endl;
+            n = 0;
+        }
+    }
+    if (n == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = cpus > 0 ? (int) cpus : 1;
+    }
+    if (n > MAX_THREADS)
+        n = MAX_THREADS;
+
+    pthread_mutex_lock(&lock);
+    threads = n;
+    pthread_mutex_unlock(&lock);
+}
+
+int ThreadPool::Threads() {
+    return threads;
+}
+
+/* Run bands of the current job until none are left.
+ * Called with lock held, returns with lock held.
+ */
+void ThreadPool::runBands() {
+    while (job_func && next_band < job_bands) {
+        RowFunc func = job_func;
+        void *data = job_data;
+        const int y0 = next_band * job_band;
+        int y1 = y0 + job_band;
+        if (y1 > job_rows)
+            y1 = job_rows;
+        next_band++;
+
+        pthread_mutex_unlock(&lock);
+        func(data, y0, y1);
+        pthread_mutex_lock(&lock);
+
+        if (++done_bands == job_bands)
+            pthread_cond_broadcast(&done_cond);
+    }
+}
+
+void *ThreadPool::worker(void *) {
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!job_func || next_band >= job_bands)
+            pthread_cond_wait(&work_cond, &lock);
+        runBands();
+    }
+    return NULL;
+}
+
+void ThreadPool::ForRows(const int rows, const int cols,
+                         RowFunc func, void *data)
+{
+    if (rows <= 0)
+        return;
+
+    pthread_mutex_lock(&lock);
+    const int n = threads;
+    if (n <= 1 || rows < 2 || (long) rows * cols < MIN_PIXELS) {
+        pthread_mutex_unlock(&lock);
+        func(data, 0, rows);
+        return;
+    }
+
+    // Start missing workers; the calling thread takes bands too.
+    // Workers block every signal, leaving them to the main thread.
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    while (workers < n - 1) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, NULL) != 0)
+            break;
+        pthread_detach(tid);
+        workers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (workers == 0) {
+        pthread_mutex_unlock(&lock);
+        func(data, 0, rows);
+        return;
+    }
+
+    // One job at a time
+    while (busy)
+        pthread_cond_wait(&done_cond, &lock);
+    busy = true;
+
+    int bands = n * BANDS_PER_THREAD;
+    if (bands > rows)
+        bands = rows;
+    job_band = (rows + bands - 1) / bands;
+    job_bands = (rows + job_band - 1) / job_band;
+    job_rows = rows;
+    job_data = data;
+    job_func = func;
+    next_band = 0;
+    done_bands = 0;
+    pthread_cond_broadcast(&work_cond);
+
+    runBands();
+    while (done_bands < job_bands)
+        pthread_cond_wait(&done_cond, &lock);
+
+    job_func = 0;
+    job_data = 0;
+    busy = false;
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,38 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+*/
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <string>
+
+/* Small pool of worker threads used to split pixel operations
+ * into bands of rows. Workers are started on first use.
+ */
+class ThreadPool {
+public:
+    typedef void (*RowFunc)(void *data, const int y0, const int y1);
+
+    /* Set the number of threads from the "threads" option:
+     * "auto" (or empty) uses the number of online CPUs.
+     */
+    static void SetThreads(const std::string& option);
+    static int Threads();
+
+    /* Call func on bands covering rows [0, rows) and wait for
+     * all of them. Small jobs (rows * cols pixels) run inline.
+     */
+    static void ForRows(const int rows, const int cols,
+                        RowFunc func, void *data);
+
+private:
+    static void *worker(void *arg);
+    static void runBands();
+};
+
+#endif
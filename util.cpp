@@ -67,3 +67,13 @@ long Util::makeseed(void)
 
 	return pid + tm + (ts.tv_sec ^ ts.tv_nsec);
 }
+
+long long Util::msecs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
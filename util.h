@@ -19,6 +19,9 @@ namespace Util {
 	long random(void);
 
 	long makeseed(void);
+
+	/* Milliseconds on the monotonic clock */
+	long long msecs(void);
 };
 
 #endif /* __UTIL_H__ */
@@ -0,0 +1,584 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   The conversion code has been adapted from xplanet 1.0.1,
+   Copyright (C) 2002-04 Hari Nair <hari@alumni.caltech.edu>
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+
+#include "ximagebuffer.h"
+#include "log.h"
+#include "const.h"
+
+/* Layout of a saved image; the pixel data follows */
+struct SavedImage {
+    char magic[8];
+    char key[16];
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;
+    unsigned int bits_per_pixel;
+    unsigned int bytes_per_line;
+    unsigned int byte_order;
+    unsigned int red_mask;
+    unsigned int green_mask;
+    unsigned int blue_mask;
+    unsigned int reserved;
+};
+
+static bool
+writeAll(int fd, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return(false);
+        }
+        p += n;
+        size -= n;
+    }
+    return(true);
+}
+
+static bool
+readAll(int fd, void *data, size_t size) {
+    char *p = (char *) data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return(false);
+        p += n;
+        size -= n;
+    }
+    return(true);
+}
+
+static const char SAVED_MAGIC[8] = { 'S', 'L', 'i', 'M', 'P', 'I', 'X', '1' };
+
+XImageBuffer::XImageBuffer(Display* display, int screen, const int w,
+                           const int h)
+    : dpy(display), scr(screen), width(w), height(h),
+      ximage(NULL), visual_info(NULL), format(FORMAT_GENERIC), swap(false),
+      order(ORDER_RGBA), direct(false), shm(false), mapping(NULL),
+      mapping_size(0), closest_pixel(NULL)
+{
+    if (!init(w, h) || shm)
+        return;
+
+    ximage->data = (char *) malloc(ximage->bytes_per_line * height);
+    if (ximage->data == NULL) {
+        XDestroyImage(ximage);
+        ximage = NULL;
+    }
+}
+
+XImageBuffer::XImageBuffer(Display* display, int screen,
+                           const char *filename, const char *key)
+    : dpy(display), scr(screen), width(0), height(0),
+      ximage(NULL), visual_info(NULL), format(FORMAT_GENERIC), swap(false),
+      order(ORDER_RGBA), direct(false), shm(false), mapping(NULL),
+      mapping_size(0), closest_pixel(NULL)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    SavedImage header;
+    if (fstat(fd, &st) < 0
+        || (size_t) st.st_size < sizeof(header)
+        || read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+        || memcmp(header.magic, SAVED_MAGIC, sizeof(header.magic)) != 0
+        || strncmp(header.key, key, sizeof(header.key)) != 0
+        || header.width >= MAX_DIMENSION
+        || header.height >= MAX_DIMENSION)
+    {
+        close(fd);
+        return;
+    }
+
+    if (!init(header.width, header.height)) {
+        close(fd);
+        return;
+    }
+
+    const size_t size = sizeof(header)
+        + (size_t) ximage->bytes_per_line * height;
+    if ((size_t) st.st_size != size
+        || header.depth != (unsigned int) ximage->depth
+        || header.bits_per_pixel != (unsigned int) ximage->bits_per_pixel
+        || header.bytes_per_line != (unsigned int) ximage->bytes_per_line
+        || header.byte_order != (unsigned int) ximage->byte_order
+        || header.red_mask != (unsigned int) visual_info->red_mask
+        || header.green_mask != (unsigned int) visual_info->green_mask
+        || header.blue_mask != (unsigned int) visual_info->blue_mask)
+    {
+        close(fd);
+        destroyImage();
+        return;
+    }
+
+    // A shared segment has to be filled; otherwise map the file
+    if (shm) {
+        bool success = readAll(fd, ximage->data, size - sizeof(header));
+        close(fd);
+        if (!success)
+            destroyImage();
+        return;
+    }
+
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        destroyImage();
+        return;
+    }
+    mapping = p;
+    mapping_size = size;
+    ximage->data = (char *) p + sizeof(header);
+}
+
+XImageBuffer::~XImageBuffer() {
+    destroyImage();
+    if (visual_info != NULL)
+        XFree(visual_info);
+    delete [] closest_pixel;
+}
+
+void
+XImageBuffer::destroyImage() {
+    if (ximage == NULL)
+        return;
+
+    if (shm) {
+        XShmDetach(dpy, &shm_info);
+        shmdt(shm_info.shmaddr);
+        ximage->data = NULL;
+        shm = false;
+    }
+    if (mapping != NULL) {
+        munmap(mapping, mapping_size);
+        mapping = NULL;
+        ximage->data = NULL;
+    }
+    // Also frees malloc'd pixel data
+    XDestroyImage(ximage);
+    ximage = NULL;
+}
+
+static bool shm_error;
+
+static int
+catchShmError(Display *, XErrorEvent *) {
+    shm_error = true;
+    return(0);
+}
+
+/* Try to create the XImage in a segment shared with the server. This
+ * fails when the server is not on this machine.
+ */
+bool
+XImageBuffer::createShmImage(Visual *visual) {
+    if (!XShmQueryExtension(dpy))
+        return(false);
+
+    ximage = XShmCreateImage(dpy, visual, depth, ZPixmap, NULL, &shm_info,
+                             width, height);
+    if (ximage == NULL)
+        return(false);
+
+    shm_info.shmid = shmget(IPC_PRIVATE,
+                            (size_t) ximage->bytes_per_line * height,
+                            IPC_CREAT | 0600);
+    if (shm_info.shmid < 0) {
+        XDestroyImage(ximage);
+        ximage = NULL;
+        return(false);
+    }
+    shm_info.shmaddr = (char *) shmat(shm_info.shmid, NULL, 0);
+    shm_info.readOnly = True;
+
+    bool attached = false;
+    if (shm_info.shmaddr != (char *) -1) {
+        shm_error = false;
+        XErrorHandler old_handler = XSetErrorHandler(catchShmError);
+        XShmAttach(dpy, &shm_info);
+        XSync(dpy, False);
+        XSetErrorHandler(old_handler);
+        attached = !shm_error;
+        if (!attached)
+            shmdt(shm_info.shmaddr);
+    }
+    // The segment goes away once both sides have detached
+    shmctl(shm_info.shmid, IPC_RMID, NULL);
+
+    if (!attached) {
+        XDestroyImage(ximage);
+        ximage = NULL;
+        return(false);
+    }
+    ximage->data = shm_info.shmaddr;
+    shm = true;
+    return(true);
+}
+
+/* Set up the conversion and an XImage without pixel data */
+bool
+XImageBuffer::init(const int w, const int h) {
+    width = w;
+    height = h;
+    depth = DefaultDepth(dpy, scr);
+    Visual *visual = DefaultVisual(dpy, scr);
+
+    int entries;
+    XVisualInfo v_template;
+    v_template.visualid = XVisualIDFromVisual(visual);
+    visual_info = XGetVisualInfo(dpy, VisualIDMask, &v_template, &entries);
+    if (visual_info == NULL)
+        return(false);
+
+    switch (visual_info->c_class) {
+    case PseudoColor:
+        initPseudoColor();
+        break;
+    case TrueColor:
+        computeTable(visual_info->red_mask, red_table);
+        computeTable(visual_info->green_mask, green_table);
+        computeTable(visual_info->blue_mask, blue_table);
+        break;
+    default:
+        return(false);
+    }
+
+    if (!createShmImage(visual)) {
+        ximage = XCreateImage(dpy, visual, depth, ZPixmap, 0, NULL,
+                              width, height, 8, 0);
+        if (ximage == NULL)
+            return(false);
+    }
+
+    // Rows in the common layouts are written directly, in the byte
+    // order of the server
+    format = FORMAT_GENERIC;
+    if (visual_info->c_class == PseudoColor)
+        format = FORMAT_PSEUDO;
+    else if (ximage->bits_per_pixel == 32)
+        format = FORMAT_32;
+    else if (ximage->bits_per_pixel == 24)
+        format = FORMAT_24;
+    else if (ximage->bits_per_pixel == 16)
+        format = FORMAT_16;
+    swap = (ximage->byte_order != hostByteOrder());
+    direct = directOrder(visual_info, depth, ximage->bits_per_pixel,
+                         ximage->byte_order, &order);
+    return(true);
+}
+
+/* Whether 24 bit TrueColor pixels of bits_per_pixel bits hold red,
+ * green and blue in separate bytes in the order of ChannelOrder, and
+ * which one.
+ */
+bool
+XImageBuffer::directOrder(const XVisualInfo *info, const int depth,
+                          const int bits_per_pixel, const int byte_order,
+                          ChannelOrder *order) {
+    *order = ORDER_RGBA;
+    if (info->c_class != TrueColor || depth != 24 || bits_per_pixel != 32)
+        return(false);
+
+    // Byte of the pixel holding each channel
+    const unsigned long masks[3] = { info->red_mask, info->green_mask,
+                                     info->blue_mask };
+    int bytes[3];
+    for (int i = 0; i < 3; i++) {
+        int shift = 0;
+        while (shift < 32 && masks[i] != (0xffUL << shift))
+            shift += 8;
+        if (shift == 32)
+            return(false);
+        bytes[i] = (byte_order == LSBFirst) ? shift / 8 : 3 - shift / 8;
+    }
+
+    if (bytes[1] != 1)
+        return(false);
+    if (bytes[0] == 0 && bytes[2] == 2) {
+        *order = ORDER_RGBA;
+        return(true);
+    }
+    if (bytes[0] == 2 && bytes[2] == 0) {
+        *order = ORDER_BGRA;
+        return(true);
+    }
+    return(false);
+}
+
+ChannelOrder
+XImageBuffer::NativeOrder(Display* dpy, int scr) {
+    const int depth = DefaultDepth(dpy, scr);
+    int bits_per_pixel = 0;
+    int count;
+    XPixmapFormatValues *formats = XListPixmapFormats(dpy, &count);
+    if (formats != NULL) {
+        for (int i = 0; i < count; i++)
+            if (formats[i].depth == depth)
+                bits_per_pixel = formats[i].bits_per_pixel;
+        XFree(formats);
+    }
+
+    int entries;
+    XVisualInfo v_template;
+    v_template.visualid = XVisualIDFromVisual(DefaultVisual(dpy, scr));
+    XVisualInfo *info = XGetVisualInfo(dpy, VisualIDMask, &v_template,
+                                       &entries);
+    if (info == NULL)
+        return(ORDER_RGBA);
+
+    ChannelOrder order;
+    directOrder(info, depth, bits_per_pixel, ImageByteOrder(dpy), &order);
+    XFree(info);
+    return(order);
+}
+
+int
+XImageBuffer::hostByteOrder() {
+    const uint32_t one = 1;
+    return(*(const unsigned char *) &one == 1 ? LSBFirst : MSBFirst);
+}
+
+/* Pixel bits for each 8 bit value of a color channel. Channels wider
+ * than 8 bits (30 bit visuals) get the high bits repeated below.
+ */
+void
+XImageBuffer::computeTable(unsigned long mask, uint32_t *table) {
+    int shift = 0;
+    int bits = 0;
+    if (mask != 0) {
+        while ((mask & 0x01) == 0) {
+            shift++;
+            mask >>= 1;
+        }
+        while ((mask & 0x01) == 1) {
+            bits++;
+            mask >>= 1;
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        uint32_t value;
+        if (bits == 0)
+            value = 0;
+        else if (bits <= 8)
+            value = i >> (8 - bits);
+        else if (bits <= 16)
+            value = (i << (bits - 8)) | (i >> (16 - bits));
+        else
+            value = i << (bits - 8);
+        table[i] = value << shift;
+    }
+}
+
+void
+XImageBuffer::initPseudoColor() {
+    int i;
+    XColor xc;
+    Colormap colormap = DefaultColormap(dpy, scr);
+
+    int num_colors = 256;
+    XColor *colors = new XColor[num_colors];
+    for (i = 0; i < num_colors; i++)
+        colors[i].pixel = (unsigned long) i;
+    XQueryColors(dpy, colormap, colors, num_colors);
+
+    closest_pixel = new unsigned long[num_colors];
+
+    for (i = 0; i < num_colors; i++) {
+        xc.red = (i & 0xe0) << 8;           // highest 3 bits
+        xc.green = (i & 0x1c) << 11;        // middle 3 bits
+        xc.blue = (i & 0x03) << 14;         // lowest 2 bits
+
+        // find the closest color in the colormap
+        double distance, distance_squared, min_distance = 0;
+        for (int ii = 0; ii < num_colors; ii++) {
+            distance = colors[ii].red - xc.red;
+            distance_squared = distance * distance;
+            distance = colors[ii].green - xc.green;
+            distance_squared += distance * distance;
+            distance = colors[ii].blue - xc.blue;
+            distance_squared += distance * distance;
+
+            if ((ii == 0) || (distance_squared <= min_distance)) {
+                min_distance = distance_squared;
+                closest_pixel[i] = colors[ii].pixel;
+            }
+        }
+    }
+    delete [] colors;
+}
+
+static inline uint32_t
+swap32(uint32_t v) {
+    return((v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000)
+           | (v << 24));
+}
+
+static inline uint16_t
+swap16(uint16_t v) {
+    return((uint16_t) ((v >> 8) | (v << 8)));
+}
+
+void
+XImageBuffer::PutRow(const int y, const unsigned char *rgba) {
+    if (ximage == NULL)
+        return;
+
+    char *line = ximage->data + y * ximage->bytes_per_line;
+    int i;
+
+    switch (format) {
+    case FORMAT_PSEUDO:
+        for (i = 0; i < width; i++) {
+            unsigned long red = rgba[4*i] & 0xe0;
+            unsigned long green = rgba[4*i + 1] & 0xe0;
+            unsigned long blue = rgba[4*i + 2] & 0xc0;
+
+            XPutPixel(ximage, i, y,
+                      closest_pixel[red | (green >> 3) | (blue >> 6)]);
+        }
+        break;
+
+    case FORMAT_32: {
+        uint32_t *out = (uint32_t *) line;
+        if (direct) {
+            memcpy(line, rgba, 4 * width);
+        } else if (swap) {
+            for (i = 0; i < width; i++, rgba += 4)
+                out[i] = swap32(red_table[rgba[0]] | green_table[rgba[1]]
+                                | blue_table[rgba[2]]);
+        } else {
+            for (i = 0; i < width; i++, rgba += 4)
+                out[i] = red_table[rgba[0]] | green_table[rgba[1]]
+                         | blue_table[rgba[2]];
+        }
+        break;
+    }
+
+    case FORMAT_24: {
+        unsigned char *out = (unsigned char *) line;
+        const bool lsb = (ximage->byte_order == LSBFirst);
+        for (i = 0; i < width; i++, rgba += 4) {
+            uint32_t pixel = red_table[rgba[0]] | green_table[rgba[1]]
+                             | blue_table[rgba[2]];
+            if (lsb) {
+                *out++ = pixel;
+                *out++ = pixel >> 8;
+                *out++ = pixel >> 16;
+            } else {
+                *out++ = pixel >> 16;
+                *out++ = pixel >> 8;
+                *out++ = pixel;
+            }
+        }
+        break;
+    }
+
+    case FORMAT_16: {
+        uint16_t *out = (uint16_t *) line;
+        if (swap) {
+            for (i = 0; i < width; i++, rgba += 4)
+                out[i] = swap16(red_table[rgba[0]] | green_table[rgba[1]]
+                                | blue_table[rgba[2]]);
+        } else {
+            for (i = 0; i < width; i++, rgba += 4)
+                out[i] = red_table[rgba[0]] | green_table[rgba[1]]
+                         | blue_table[rgba[2]];
+        }
+        break;
+    }
+
+    default:
+        for (i = 0; i < width; i++, rgba += 4)
+            XPutPixel(ximage, i, y, red_table[rgba[0]] | green_table[rgba[1]]
+                                    | blue_table[rgba[2]]);
+        break;
+    }
+}
+
+Pixmap
+XImageBuffer::CreatePixmap(Window win) {
+    Pixmap tmp = XCreatePixmap(dpy, win, width, height, depth);
+
+    if (ximage == NULL) {
+        logStream << "Login.app: could not load image" << endl;
+        return(tmp);
+    }
+
+    GC gc = XCreateGC(dpy, win, 0, NULL);
+    if (shm) {
+        XShmPutImage(dpy, tmp, gc, ximage, 0, 0, 0, 0, width, height, False);
+        // The segment must stay intact until the server has copied it
+        XSync(dpy, False);
+    } else {
+        XPutImage(dpy, tmp, gc, ximage, 0, 0, 0, 0, width, height);
+    }
+    XFreeGC(dpy, gc);
+
+    return(tmp);
+}
+
+bool
+XImageBuffer::Save(const char *filename, const char *key) const {
+    if (ximage == NULL)
+        return(false);
+
+    SavedImage header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SAVED_MAGIC, sizeof(header.magic));
+    strncpy(header.key, key, sizeof(header.key));
+    header.width = width;
+    header.height = height;
+    header.depth = ximage->depth;
+    header.bits_per_pixel = ximage->bits_per_pixel;
+    header.bytes_per_line = ximage->bytes_per_line;
+    header.byte_order = ximage->byte_order;
+    header.red_mask = visual_info->red_mask;
+    header.green_mask = visual_info->green_mask;
+    header.blue_mask = visual_info->blue_mask;
+
+    // Write a new file and move it into place, so that a reader never
+    // maps a partial image
+    std::string tmp = std::string(filename) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return(false);
+
+    bool success = writeAll(fd, &header, sizeof(header))
+        && writeAll(fd, ximage->data,
+                    (size_t) ximage->bytes_per_line * height);
+    if (close(fd) < 0)
+        success = false;
+    if (success && rename(tmp.c_str(), filename) < 0)
+        success = false;
+    if (!success)
+        unlink(tmp.c_str());
+    return(success);
+}
@@ -0,0 +1,121 @@
+/* SLiM - Simple Login Manager
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   The conversion code has been adapted from xplanet 1.0.1,
+   Copyright (C) 2002-04 Hari Nair <hari@alumni.caltech.edu>
+*/
+
+#ifndef _XIMAGEBUFFER_H_
+#define _XIMAGEBUFFER_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include "scaler.h"
+
+/* An XImage in the format of the default visual of a screen.
+ * RGBA rows are converted into it as they arrive, then the whole
+ * buffer is uploaded into a new Pixmap. With a local server the buffer
+ * is a MIT-SHM segment and the upload does not copy through the socket.
+ * If the pixels of the visual are 32 bit RGBA or BGRA bytes, rows in
+ * that order are copied as they are.
+ */
+class XImageBuffer : public RowSink {
+public:
+    XImageBuffer(Display* dpy, int scr, const int w, const int h);
+
+    /* Map an image written by Save; not Valid() if the file is missing
+     * or was saved with a different key or for a different visual.
+     */
+    XImageBuffer(Display* dpy, int scr, const char *filename,
+                 const char *key);
+    ~XImageBuffer();
+
+    /* False if the visual is not supported */
+    bool Valid() const {
+        return(ximage != NULL);
+    };
+    int Width() const {
+        return(width);
+    };
+    int Height() const {
+        return(height);
+    };
+
+    /* Convert one row of 4 * width bytes in Order(), ignoring alpha;
+     * rows may be converted concurrently.
+     */
+    void PutRow(const int y, const unsigned char *rgba);
+    ChannelOrder Order() const {
+        return(order);
+    };
+
+    /* The channel order whose pixels the default visual of scr takes
+     * without conversion, or ORDER_RGBA if there is none */
+    static ChannelOrder NativeOrder(Display* dpy, int scr);
+
+    Pixmap CreatePixmap(Window win);
+
+    /* Write the converted pixels to filename along with a key of up to
+     * 16 characters identifying their source.
+     */
+    bool Save(const char *filename, const char *key) const;
+
+private:
+    XImageBuffer();
+    XImageBuffer(const XImageBuffer&);
+    XImageBuffer& operator=(const XImageBuffer&);
+
+    bool init(const int w, const int h);
+    bool createShmImage(Visual *visual);
+    void destroyImage();
+    static int hostByteOrder();
+    static bool directOrder(const XVisualInfo *info, const int depth,
+                            const int bits_per_pixel, const int byte_order,
+                            ChannelOrder *order);
+    static void computeTable(unsigned long mask, uint32_t *table);
+    void initPseudoColor();
+
+    enum Format {
+        FORMAT_PSEUDO,
+        FORMAT_GENERIC,     // through XPutPixel
+        FORMAT_16,
+        FORMAT_24,
+        FORMAT_32
+    };
+
+    Display *dpy;
+    int scr;
+    int width, height;
+    int depth;
+    XImage *ximage;
+    XVisualInfo *visual_info;
+    Format format;
+    bool swap;              // server byte order differs from ours
+    ChannelOrder order;     // of the rows PutRow takes
+    bool direct;            // rows are copied unconverted
+
+    // Pixel data shared with the server, if possible
+    bool shm;
+    XShmSegmentInfo shm_info;
+
+    // Saved image the pixel data points into, if any
+    void *mapping;
+    size_t mapping_size;
+
+    // TrueColor: pixel bits for each value of a channel
+    uint32_t red_table[256];
+    uint32_t green_table[256];
+    uint32_t blue_table[256];
+
+    // PseudoColor: colormap entry for each 3-3-2 color
+    unsigned long *closest_pixel;
+};
+
+#endif